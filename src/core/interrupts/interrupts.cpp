@@ -5,6 +5,7 @@ namespace uqaabOS {
 namespace interrupts {
 
 InterruptManager *InterruptManager::ActiveInterrruptManager = 0;
+volatile uint32_t InterruptManager::interrupt_depth = 0;
 
 InterruptHandler::InterruptHandler(InterruptManager *interrupt_manager,
                                    uint8_t interrupt_number) {
@@ -105,6 +106,10 @@ InterruptManager::InterruptManager(uint16_t hardware_interrupt_offset,
   setGateDescriptor(hardware_interrupt_offset + 0x0F, code_segment, &IRQ0x0F, 0,
                     IDT_INTERRUPT_GATE);
 
+  // software interrupt used by tasks to yield the CPU
+  setGateDescriptor(TASK_YIELD_INTERRUPT, code_segment, &IRQ0x31, 0,
+                    IDT_INTERRUPT_GATE);
+
   // handle exceptions(Trap Gate)
   const uint8_t IDT_TRAP_GATE = 0xF;
   setGateDescriptor(0x00, code_segment, &handle_exception0x00, 0,
@@ -227,11 +232,16 @@ const char *exception_messages[] = {"Divide By Zero Exception\n",
                                     "Reserved Exception\n",
                                     "Reserved Exception\n"};
 
+bool InterruptManager::in_interrupt() { return interrupt_depth != 0; }
+
 uint32_t InterruptManager::do_handle_interrupt(uint8_t interrupt_number,
                                                uint32_t esp) {
+  interrupt_depth++;
+
   if (handlers[interrupt_number] != 0) {
     esp = handlers[interrupt_number]->handle_interrupt(esp);
-  } else if (interrupt_number != hardware_interrupt_offset) {
+  } else if (interrupt_number != hardware_interrupt_offset &&
+             interrupt_number != TASK_YIELD_INTERRUPT) {
     if (interrupt_number <
         sizeof(exception_messages) / sizeof(exception_messages[0])) {
       libc::printf("EXCEPTION: ");
@@ -243,7 +253,20 @@ uint32_t InterruptManager::do_handle_interrupt(uint8_t interrupt_number,
     }
   }
 
-  if (interrupt_number == hardware_interrupt_offset) {
+  // A task gave up the CPU
+  if (interrupt_number == TASK_YIELD_INTERRUPT) {
+    esp = (uint32_t)(task_manager->schedule((multitasking::CPUState *)esp));
+  }
+
+  // Without a timer driver every IRQ0 is a scheduling point; a timer
+  // driver (PITDriver) installs its own handler and decides per quantum.
+  if (interrupt_number == hardware_interrupt_offset &&
+      handlers[interrupt_number] == 0) {
+    esp = (uint32_t)(task_manager->schedule((multitasking::CPUState *)esp));
+  }
+
+  // A handler woke a task that should run before the interrupted one
+  if (task_manager->needs_reschedule()) {
     esp = (uint32_t)(task_manager->schedule((multitasking::CPUState *)esp));
   }
 
@@ -256,6 +279,7 @@ uint32_t InterruptManager::do_handle_interrupt(uint8_t interrupt_number,
     }
   }
 
+  interrupt_depth--;
   return esp;
 }
 } // namespace interrupts
@@ -49,6 +49,14 @@ namespace uqaabOS{
             return read16(portNumber);
         }
 
+        void Port16Bit::read_block(uint16_t* buffer , uint32_t words){
+            read16_block(portNumber , buffer , words);
+        }
+
+        void Port16Bit::write_block(const uint16_t* buffer , uint32_t words){
+            write16_block(portNumber , buffer , words);
+        }
+
         //32bits port 
         Port32Bit::Port32Bit(uint16_t portNumber):Port(portNumber){}
 
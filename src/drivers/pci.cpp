@@ -142,6 +142,10 @@ namespace uqaabOS
         {
 
             BaseAdressRegister result;
+            result.prefetchable = false;
+            result.address = 0;
+            result.size = 0;
+            result.type = memory_mapping;
 
             uint32_t header_type = read(bus, device, function, 0x0E) & 0x7F;
 
@@ -177,6 +181,43 @@ namespace uqaabOS
             return result;
         }
 
+        bool PCIController::find_device(uint8_t class_id, uint8_t sub_class_id, PeripheralComponentInterconnectDeviceDescriptor *result)
+        {
+
+            for (int bus = 0; bus < 8; bus++)
+            {
+
+                for (int device = 0; device < 32; device++)
+                {
+
+                    int num_functions = device_has_functions(bus, device) ? 8 : 1;
+
+                    for (int function = 0; function < num_functions; function++)
+                    {
+
+                        PeripheralComponentInterconnectDeviceDescriptor dev = get_device_descriptor(bus, device, function);
+
+                        if (dev.vendor_id == 0x0000 || dev.vendor_id == 0xFFFF)
+                            continue;
+
+                        if (dev.class_id == class_id && dev.sub_class_id == sub_class_id)
+                        {
+                            *result = dev;
+                            return true;
+                        }
+                    }
+                }
+            }
+            return false;
+        }
+
+        void PCIController::enable_bus_mastering(PeripheralComponentInterconnectDeviceDescriptor *dev)
+        {
+            /*offset 0x04: command register (low 16 bits), bit 2 = bus master; the status half is left zero*/
+            uint32_t command = read(dev->bus, dev->device, dev->function, 0x04) & 0xFFFF;
+            write(dev->bus, dev->device, dev->function, 0x04, command | 0x4);
+        }
+
         Driver *PCIController::get_driver(PeripheralComponentInterconnectDeviceDescriptor dev, uqaabOS::interrupts::InterruptManager *interrupt_manager)
         {
 
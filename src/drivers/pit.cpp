@@ -0,0 +1,84 @@
+#include <stdint.h>
+
+#include "../include/drivers/pit.h"
+
+namespace uqaabOS {
+
+namespace driver {
+
+PITDriver *PITDriver::active_timer = 0;
+
+/*
+  -> IRQ0 is delivered at the hardware interrupt offset (0x20).
+  -> channel0_port 0x40, reload value of the channel 0 counter.
+  -> command_port 0x43, selects channel, access mode and operating mode.
+*/
+PITDriver::PITDriver(interrupts::InterruptManager *manager,
+                     multitasking::TaskManager *task_manager,
+                     uint32_t frequency)
+    : interrupts::InterruptHandler(manager, manager->hardwareInterruptOffset()),
+      channel0_port(0x40), command_port(0x43) {
+  this->task_manager = task_manager;
+  this->frequency = frequency;
+  ticks = 0;
+  active_timer = this;
+}
+
+PITDriver::~PITDriver() {
+  if (active_timer == this)
+    active_timer = 0;
+}
+
+void PITDriver::activate() { set_frequency(frequency); }
+
+void PITDriver::set_frequency(uint32_t frequency) {
+  // The 16-bit reload value bounds the rate to ~19 Hz .. 1.19 MHz
+  uint32_t divisor = frequency ? PIT_BASE_FREQUENCY / frequency : 0x10000;
+  if (divisor == 0)
+    divisor = 1;
+  if (divisor > 0x10000)
+    divisor = 0x10000;
+  this->frequency = PIT_BASE_FREQUENCY / divisor;
+
+  // command 0x34 = channel 0, lobyte/hibyte access, mode 2 (rate generator)
+  command_port.write(0x34);
+  // a reload value of 0 means 65536
+  channel0_port.write(divisor & 0xFF);
+  channel0_port.write((divisor >> 8) & 0xFF);
+
+  // Timed sleeps are expressed in ticks of this rate
+  if (task_manager != 0)
+    task_manager->set_tick_frequency(this->frequency);
+}
+
+uint32_t PITDriver::get_frequency() { return frequency; }
+
+uint64_t PITDriver::get_ticks() {
+  // a 64-bit read is two loads; retry if IRQ0 updated it in between
+  uint64_t value;
+  do {
+    value = ticks;
+  } while (value != ticks);
+  return value;
+}
+
+uint32_t PITDriver::uptime_ms() {
+  uint64_t now = get_ticks();
+  // split to stay within 32-bit division (no libgcc in the kernel)
+  uint32_t seconds = (uint32_t)now / frequency;
+  uint32_t remainder = (uint32_t)now % frequency;
+  return seconds * 1000 + remainder * 1000 / frequency;
+}
+
+uint32_t PITDriver::handle_interrupt(uint32_t esp) {
+  ticks++;
+
+  // Preempt the running task once its quantum is used up
+  if (task_manager != 0 && task_manager->tick())
+    esp = (uint32_t)task_manager->schedule((multitasking::CPUState *)esp);
+
+  return esp;
+}
+
+} // namespace driver
+} // namespace uqaabOS
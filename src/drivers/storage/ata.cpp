@@ -1,4 +1,5 @@
 #include "../../include/drivers/storage/ata.h"
+#include "../../include/libc/string.h"
 #include <cstdint>
 
 namespace uqaabOS {
@@ -22,6 +23,15 @@ ATA::ATA(uqaabOS::interrupts::InterruptManager* interrupt_manager, bool master,
                    0x206) // Initialize control port at base + 0x206.
 {
   this->master = master; // Set the master flag.
+  irq_received = false;
+  irq_status = 0;
+  interrupt_driven = true;
+  multiple_sectors = 1;
+  dma = 0;
+  info.present = false;
+  info.lba48 = false;
+  info.dma = false;
+  info.sector_count = 0;
 }
 
 // Destructor for ATA class (currently no dynamic resources to free).
@@ -30,18 +40,35 @@ ATA::~ATA() {}
 // Handle interrupt for ATA device
 uint32_t ATA::handle_interrupt(uint32_t esp) {
   // Read the status to acknowledge the interrupt
-  uint8_t status = command_port.read();
-  
-  // For now, just print that we received an interrupt
-  // In a full implementation, you might want to signal a waiting thread or update flags
-  // libc::printf("ATA Interrupt Received - Status: %x\n", status);
-  
+  irq_status = command_port.read();
+  irq_received = true;
+
+  // Let a task waiting for this transfer run
+  if (multitasking::TaskManager::active_task_manager != 0)
+    multitasking::TaskManager::active_task_manager->wake_up(&irq_queue);
+
   return esp;
 }
 
-// identify(): Sends the IDENTIFY command to the device and prints its returned
-// identification data.
-void ATA::identify() {
+// Copies an IDENTIFY string (two characters per word, high byte first) and
+// drops the trailing space padding.
+static void copy_identify_string(char *out, const uint16_t *words,
+                                 int word_count) {
+  for (int i = 0; i < word_count; i++) {
+    out[i * 2] = words[i] >> 8;
+    out[i * 2 + 1] = words[i] & 0xFF;
+  }
+  int length = word_count * 2;
+  while (length > 0 && out[length - 1] == ' ')
+    length--;
+  out[length] = 0;
+}
+
+// identify(): Sends the IDENTIFY command to the device, fills 'info' from
+// the returned data and prints a summary.
+bool ATA::identify() {
+  info.present = false;
+
   device_port.write(
       master ? 0xA0 : 0xB0); // Select master (0xA0) or slave (0xB0) device.
   control_port.write(0);     // Clear the control port.
@@ -49,7 +76,7 @@ void ATA::identify() {
   device_port.write(0xA0); // Set device register to master (if applicable).
   uint8_t status = command_port.read(); // Read the device status.
   if (status == 0xFF) // If status is 0xFF, the device is not present.
-    return;
+    return false;
 
   device_port.write(master ? 0xA0
                            : 0xB0); // Re-select device based on master flag.
@@ -61,7 +88,7 @@ void ATA::identify() {
 
   status = command_port.read(); // Read the status after issuing the command.
   if (status == 0x00)           // If status is 0x00, no device is present.
-    return;
+    return false;
 
   // Wait until the device is not busy (BSY cleared) and no error bit is set.
   while (((status & 0x80) == 0x80) && ((status & 0x01) != 0x01))
@@ -69,189 +96,518 @@ void ATA::identify() {
 
   if (status & 0x01) {     // If an error is indicated...
     libc::printf("ERROR"); // ...print an error message.
-    return;
+    return false;
   }
 
   uint16_t identify_data[256];
-  for (int i = 0; i < 256; i++) {
-    identify_data[i] = data_port.read();
+  data_port.read_block(identify_data, 256);
+
+  info.present = true;
+  copy_identify_string(info.serial, &identify_data[10], 10); // Words 10-19
+  copy_identify_string(info.model, &identify_data[27], 20);  // Words 27-46
+
+  // Word 83, bit 10: 48-bit addressing. Words 100-103 then hold the
+  // capacity; words 60-61 saturate at 0x0FFFFFFF.
+  info.lba48 = (identify_data[83] & 0x0400) != 0;
+  info.sectors28 = identify_data[60] | ((uint32_t)identify_data[61] << 16);
+  if (info.lba48)
+    info.sector_count = identify_data[100] |
+                        ((uint64_t)identify_data[101] << 16) |
+                        ((uint64_t)identify_data[102] << 32) |
+                        ((uint64_t)identify_data[103] << 48);
+  else
+    info.sector_count = info.sectors28;
+
+  // Word 106, bit 12 (valid when bits 14-15 are 01): logical sectors are
+  // longer than 256 words; words 117-118 give the length in words.
+  info.bytes_per_sector = 512;
+  if ((identify_data[106] & 0xC000) == 0x4000 &&
+      (identify_data[106] & 0x1000))
+    info.bytes_per_sector =
+        (identify_data[117] | ((uint32_t)identify_data[118] << 16)) * 2;
+
+  // Word 47, bits 0-7: largest block READ/WRITE MULTIPLE can transfer.
+  info.max_multiple = identify_data[47] & 0xFF;
+
+  // Word 49, bit 8: DMA. Word 63 and (if word 53 bit 2 is set) word 88
+  // list the supported Multiword and Ultra DMA modes in their low bytes.
+  info.dma = (identify_data[49] & 0x0100) != 0;
+  info.multiword_dma_modes = identify_data[63] & 0xFF;
+  info.ultra_dma_modes =
+      (identify_data[53] & 0x0004) ? (identify_data[88] & 0xFF) : 0;
+
+  libc::printf("Model Number: %s\n", info.model);
+  libc::printf("Serial Number: %s\n", info.serial);
+  // Size in MiB, shifted rather than divided (no 64-bit division helpers)
+  libc::printf("Capacity: %d MiB, %s\n",
+               (uint32_t)(info.sector_count >> 11),
+               info.lba48 ? "LBA48" : "LBA28");
+
+  if (info.bytes_per_sector != 512)
+    libc::printf("WARNING: %d-byte sectors are not supported\n",
+                 info.bytes_per_sector);
+
+  if (info.max_multiple > 1 && set_multiple_mode(info.max_multiple))
+    libc::printf("Multiple mode: %d sectors per block\n", info.max_multiple);
+  return true;
+}
+
+const ATADeviceInfo *ATA::get_device_info() { return &info; }
+
+// set_multiple_mode(): Sets the number of sectors moved per DRQ block by
+// READ MULTIPLE and WRITE MULTIPLE.
+bool ATA::set_multiple_mode(uint8_t sectors) {
+  if (sectors == 0)
+    return false;
+
+  uint8_t status = wait_not_busy();
+  if (status & ATA_STATUS_BSY)
+    return false;
+
+  issue_command28(0xC6, 0, sectors); // SET MULTIPLE MODE
+  status = wait_for_interrupt();
+  if (status & (ATA_STATUS_BSY | ATA_STATUS_ERR | ATA_STATUS_DF)) {
+    // The drive rejected the size; keep using single-sector commands
+    multiple_sectors = 1;
+    return false;
+  }
+
+  multiple_sectors = sectors;
+  return true;
+}
+
+uint8_t ATA::get_multiple_sectors() { return multiple_sectors; }
+
+// attach_dma(): Hands whole-sector transfers to the bus-master engine.
+bool ATA::attach_dma(IDEBusMaster *dma) {
+  if (dma != 0 && !info.dma)
+    return false;
+  this->dma = dma;
+  return true;
+}
+
+// set_interrupt_driven(): Chooses between sleeping on IRQ 14 and polling.
+void ATA::set_interrupt_driven(bool enabled) { interrupt_driven = enabled; }
+
+// wait_not_busy(): Polls the alternate status register, which does not
+// acknowledge the interrupt, until the device clears BSY.
+uint8_t ATA::wait_not_busy() {
+  // The status is only valid 400ns after a command; four reads cover that.
+  uint8_t status = control_port.read();
+  for (int i = 0; i < 3; i++)
+    status = control_port.read();
+
+  int timeout = ATA_POLL_TIMEOUT;
+  while ((status & ATA_STATUS_BSY) && timeout > 0) {
+    status = control_port.read();
+    timeout--;
+  }
+  return status;
+}
+
+// issue_command28(): Programs the task file for a 28-bit LBA command.
+void ATA::issue_command28(uint8_t command, uint32_t sector_num, uint8_t count) {
+  // The IRQ of this command must not be confused with an earlier one.
+  irq_received = false;
+
+  device_port.write((master ? 0xE0 : 0xF0) | ((sector_num & 0x0F000000) >> 24));
+  error_port.write(0);
+  sector_count_port.write(count);
+  lba_low_port.write(sector_num & 0x000000FF);
+  lba_mid_port.write((sector_num & 0x0000FF00) >> 8);
+  lba_high_port.write((sector_num & 0x00FF0000) >> 16);
+  command_port.write(command);
+}
+
+// issue_command48(): Programs the task file for a 48-bit LBA command. Each
+// register is a two-byte FIFO: the high bytes go in first, then the low.
+void ATA::issue_command48(uint8_t command, uint64_t sector_num,
+                          uint16_t count) {
+  irq_received = false;
+
+  device_port.write(master ? 0x40 : 0x50); // LBA mode, no address bits here
+  sector_count_port.write(count >> 8);
+  lba_low_port.write((sector_num >> 24) & 0xFF);
+  lba_mid_port.write((sector_num >> 32) & 0xFF);
+  lba_high_port.write((sector_num >> 40) & 0xFF);
+  sector_count_port.write(count & 0xFF);
+  lba_low_port.write(sector_num & 0xFF);
+  lba_mid_port.write((sector_num >> 8) & 0xFF);
+  lba_high_port.write((sector_num >> 16) & 0xFF);
+  command_port.write(command);
+}
+
+// wait_for_interrupt(): Blocks the calling task until handle_interrupt()
+// reports completion, leaving the CPU to other tasks during seek and
+// rotation. Falls back to polling when no task can block.
+uint8_t ATA::wait_for_interrupt() {
+  multitasking::TaskManager *task_manager =
+      multitasking::TaskManager::active_task_manager;
+
+  if (interrupt_driven && task_manager != 0 &&
+      !interrupts::InterruptManager::in_interrupt()) {
+    uint32_t timeout = task_manager->milliseconds_to_ticks(ATA_IRQ_TIMEOUT_MS);
+    uint32_t flags = multitasking::disable_interrupts();
+
+    // Without IF set IRQ 14 cannot arrive, and without a timer the wait
+    // could never time out.
+    if ((flags & 0x200) && timeout != 0) {
+      uint64_t deadline = task_manager->get_ticks() + timeout;
+      while (!irq_received) {
+        uint64_t now = task_manager->get_ticks();
+        if (now >= deadline)
+          break;
+        task_manager->sleep_on_timeout(&irq_queue, (uint32_t)(deadline - now));
+      }
+    }
+    multitasking::restore_interrupts(flags);
+
+    if (irq_received)
+      return irq_status;
+    // Lost or masked interrupt: check the device directly below.
+  }
+
+  uint8_t status = wait_not_busy();
+  if (status & ATA_STATUS_BSY)
+    return status;
+  // Reading the regular status register acknowledges the interrupt.
+  return command_port.read();
+}
+
+// check_status(): Decodes the status of a finished wait. 'expect_data' is
+// set when the drive must be asking for (or offering) the next data block.
+bool ATA::check_status(uint8_t status, bool expect_data,
+                       const char *operation) {
+  if (status & ATA_STATUS_BSY) {
+      libc::printf("ERROR: %s operation timed out.\n", operation);
+      return false;
   }
 
-  // Extract the model number (words 27–46)
-  char model[41] = {0}; // 40 characters + null terminator
-  for (int i = 0; i < 20; i++) {
-    model[i * 2] = identify_data[27 + i] & 0xFF;     // Low byte
-    model[i * 2 + 1] = (identify_data[27 + i] >> 8); // High byte
+  if (status & (ATA_STATUS_ERR | ATA_STATUS_DF)) { // If an error occurred...
+      uint8_t error_code = error_port.read();
+      libc::printf("ERROR: %s failed. Error code: 0x%x\n", operation,
+                   error_code);
+      return false;
   }
-  libc::printf("Model Number: %s\n", model);
 
-  // Extract the serial number (words 10–19)
-  char serial[21] = {0}; // 20 characters + null terminator
-  for (int i = 0; i < 10; i++) {
-    serial[i * 2] = identify_data[10 + i] & 0xFF;
-    serial[i * 2 + 1] = (identify_data[10 + i] >> 8);
+  if (expect_data && !(status & ATA_STATUS_DRQ)) {
+      libc::printf("ERROR: %s failed. Device did not request data.\n",
+                   operation);
+      return false;
   }
-  libc::printf("Serial Number: %s\n", serial);
+  return true;
 }
 
-// read28(): Reads data from a given sector using 28-bit LBA addressing.
-void ATA::read28(uint32_t sector_num, uint8_t *data, uint32_t count) {
+// begin_read28(): Issues READ SECTORS for one sector and returns at once.
+bool ATA::begin_read28(uint32_t sector_num) {
   if (sector_num > 0x0FFFFFFF) {
       libc::printf("ERROR: Sector number out of range.\n");
-      return;
+      return false;
   }
 
+  // Wait for the device to be ready.
+  uint8_t status = wait_not_busy();
+  if (status & (ATA_STATUS_BSY | ATA_STATUS_ERR)) {
+      libc::printf("ERROR: Device not ready or error occurred.\n");
+      return false;
+  }
+
+  issue_command28(0x20, sector_num, 1); // READ SECTORS
+  return true;
+}
+
+// end_read28(): Waits until the sector is ready and reads it into 'data'.
+bool ATA::end_read28(uint8_t *data, uint32_t count) {
   if (data == nullptr) {
       libc::printf("ERROR: Data buffer is null.\n");
-      return;
+      return false;
   }
 
   if (count > 512) {
       libc::printf("ERROR: Count exceeds sector size (512 bytes).\n");
-      return;
+      return false;
   }
 
-  // Wait for the device to be ready.
-  uint8_t status = command_port.read();
-  while (status & 0x80) { // Wait while the device is busy.
-      status = command_port.read();
-  }
+  if (!check_status(wait_for_interrupt(), true, "Read"))
+      return false;
 
-  if (status & 0x01) { // Check for errors.
-      libc::printf("ERROR: Device not ready or error occurred.\n");
-      return;
+  // A whole sector goes straight into the caller's buffer; a partial one
+  // is read in full and the requested prefix copied out.
+  if (count == 512) {
+      data_port.read_block((uint16_t *)data, 256);
+      return true;
   }
 
-  // Set up the device for reading.
-  device_port.write((master ? 0xE0 : 0xF0) | ((sector_num & 0x0F000000) >> 24));
-  error_port.write(0);
-  sector_count_port.write(1);
-  lba_low_port.write(sector_num & 0x000000FF);
-  lba_mid_port.write((sector_num & 0x0000FF00) >> 8);
-  lba_high_port.write((sector_num & 0x00FF0000) >> 16);
+  uint16_t sector[256];
+  data_port.read_block(sector, 256);
+  libc::memcpy(data, sector, count);
+  return true;
+}
 
-  // Send the READ command
-  command_port.write(0x20);
-  
-  // Wait for the device to complete the operation or for an interrupt.
-  // We'll poll for now but the interrupt handler will also be called.
-  status = command_port.read();
-  int timeout = 1000000; // Timeout counter to prevent infinite loop
-  while ((status & 0x80) && !(status & 0x01) && timeout > 0) {
-      status = command_port.read();
-      timeout--;
-  }
+// begin_write28(): Issues WRITE SECTORS and hands the sector to the drive.
+// The drive raises IRQ 14 once the data is written, not before.
+bool ATA::begin_write28(uint32_t sector_num, uint8_t *data, uint32_t count) {
+  if (sector_num >
+      0x0FFFFFFF) // Validate that the sector number fits in 28 bits.
+    return false;
+  if (count >
+      512) // Ensure that no more than one sector (512 bytes) is written.
+    return false;
 
-  if (timeout <= 0) {
-      libc::printf("ERROR: Read operation timed out.\n");
-      return;
+  // Wait for the device to be ready.
+  uint8_t status = wait_not_busy();
+  if (status & ATA_STATUS_BSY) {
+      libc::printf("ERROR: Device not ready.\n");
+      return false;
   }
 
-  if (status & 0x01) { // If an error occurred...
-      uint8_t error_code = error_port.read();
-      libc::printf("ERROR: Read failed. Error code: 0x%x\n", error_code);
-      return;
-  }
+  issue_command28(0x30, sector_num, 1); // WRITE SECTORS
 
-  // Read the data.
-  for (int i = 0; i < count; i += 2) {
-      uint16_t wdata = data_port.read();
-      data[i] = wdata & 0x00FF;
-      if (i + 1 < count) {
-          data[i + 1] = (wdata >> 8) & 0x00FF;
-      }
+  // The first sector of a write is requested with DRQ, without an IRQ.
+  status = wait_not_busy();
+  if ((status & (ATA_STATUS_BSY | ATA_STATUS_ERR | ATA_STATUS_DF)) ||
+      !(status & ATA_STATUS_DRQ)) {
+      libc::printf("ERROR: Write not accepted. Status: 0x%x\n", status);
+      return false;
   }
 
-  // Discard remaining words if count < 512.
-  for (int i = count + (count % 2); i < 512; i += 2) {
-      data_port.read();
+  if (count == 512) {
+    data_port.write_block((uint16_t *)data, 256);
+    return true;
   }
+
+  // Pad a partial sector with zeros.
+  uint16_t sector[256];
+  libc::memset(sector, 0, sizeof(sector));
+  libc::memcpy(sector, data, count);
+  data_port.write_block(sector, 256);
+  return true;
+}
+
+// end_write28(): Waits for the drive to report the write as finished.
+bool ATA::end_write28() {
+  return check_status(wait_for_interrupt(), false, "Write");
+}
+
+// transfer_complete(): True once end_read28/end_write28 would not block.
+bool ATA::transfer_complete() {
+  return irq_received || !(control_port.read() & ATA_STATUS_BSY);
+}
+
+// read28(): Reads data from a given sector using 28-bit LBA addressing.
+void ATA::read28(uint32_t sector_num, uint8_t *data, uint32_t count) {
+  if (begin_read28(sector_num))
+    end_read28(data, count);
 }
 
 // write28(): Writes data to a given sector using 28-bit LBA addressing.
 void ATA::write28(uint32_t sector_num, uint8_t *data, uint32_t count) {
-  if (sector_num >
-      0x0FFFFFFF) // Validate that the sector number fits in 28 bits.
-    return;
-  if (count >
-      512) // Ensure that no more than one sector (512 bytes) is written.
-    return;
+  if (begin_write28(sector_num, data, count))
+    end_write28();
+}
 
-  // Wait for the device to be ready.
-  uint8_t status = command_port.read();
-  while (status & 0x80) { // Wait while the device is busy.
-      status = command_port.read();
+// transfer(): Moves whole sectors with one command. Bus-master DMA is used
+// when an engine is attached and can reach the buffer, READ/WRITE MULTIPLE
+// when multiple mode is on, and single-sector-per-IRQ PIO otherwise.
+bool ATA::transfer(uint64_t sector_num, uint8_t *data, uint32_t sector_count,
+                   bool write, bool lba48) {
+  const char *operation = write ? "Write" : "Read";
+
+  uint8_t status = wait_not_busy();
+  if (status & (ATA_STATUS_BSY | ATA_STATUS_ERR)) {
+    libc::printf("ERROR: Device not ready or error occurred.\n");
+    return false;
   }
 
-  // Set the device register with the upper LBA bits and select master/slave.
-  device_port.write((master ? 0xE0 : 0xF0) | ((sector_num & 0x0F000000) >> 24));
-  error_port.write(0);                         // Clear the error register.
-  sector_count_port.write(1);                  // Set sector count to 1.
-  lba_low_port.write(sector_num & 0x000000FF); // Write the LBA low byte.
-  lba_mid_port.write((sector_num & 0x0000FF00) >> 8); // Write the LBA mid byte.
-  lba_high_port.write((sector_num & 0x00FF0000) >>
-                      16);  // Write the LBA high byte.
-  command_port.write(0x30); // Send the WRITE command (0x30).
-
-  libc::printf(
-      "Writing to ATA Drive: "); // Inform that data writing is in progress.
-  // Write the data in 16-bit chunks.
-  for (int i = 0; i < count; i += 2) {
-    uint16_t wdata = data[i]; // Get the first byte.
-    if (i + 1 < count)
-      wdata |= ((uint16_t)data[i + 1])
-               << 8;        // Combine with the second byte if available.
-    data_port.write(wdata); // Write the 16-bit word to the data port.
-
-    char *text = "  \0";           // Temporary buffer for output.
-    text[0] = (wdata >> 8) & 0xFF; // Extract the upper byte.
-    text[1] = wdata & 0xFF;        // Extract the lower byte.
-    libc::printf(text);            // Print the two-character string.
+  bool use_dma = dma != 0 && dma->prepare(data, sector_count * 512, !write);
+  uint32_t block = multiple_sectors;
+
+  uint8_t command;
+  if (use_dma)
+    command = lba48 ? (write ? 0x35 : 0x25) : (write ? 0xCA : 0xC8);
+  else if (block > 1)
+    command = lba48 ? (write ? 0x39 : 0x29) : (write ? 0xC5 : 0xC4);
+  else
+    command = lba48 ? (write ? 0x34 : 0x24) : (write ? 0x30 : 0x20);
+
+  // A count register value of 0 means the maximum (256 or 65536 sectors)
+  if (lba48)
+    issue_command48(command, sector_num, sector_count & 0xFFFF);
+  else
+    issue_command28(command, (uint32_t)sector_num, sector_count & 0xFF);
+
+  if (use_dma) {
+    dma->start();
+    status = wait_for_interrupt();
+    uint8_t dma_status = dma->stop();
+    // The buffer was filled behind the compiler's back
+    asm volatile("" : : : "memory");
+
+    if (dma_status & IDE_BM_STATUS_ERROR) {
+      libc::printf("ERROR: DMA transfer failed. Status: 0x%x\n", dma_status);
+      return false;
+    }
+    return check_status(status, false, operation);
+  }
+
+  uint16_t *words = (uint16_t *)data;
+  uint32_t remaining = sector_count;
+
+  // A write's first block is requested with DRQ; every later block, and
+  // the end of the command, with an IRQ.
+  if (write && !check_status(wait_not_busy(), true, operation))
+    return false;
+
+  while (remaining > 0) {
+    if (!write && !check_status(wait_for_interrupt(), true, operation))
+      return false;
+
+    uint32_t sectors = remaining < block ? remaining : block;
+    // The next block's IRQ comes only after this one has been moved.
+    irq_received = false;
+    if (write)
+      data_port.write_block(words, sectors * 256);
+    else
+      data_port.read_block(words, sectors * 256);
+    words += sectors * 256;
+    remaining -= sectors;
+
+    if (write && !check_status(wait_for_interrupt(), remaining > 0, operation))
+      return false;
   }
+  return true;
+}
 
-  // Write zero padding if less than 512 bytes of data were provided.
-  for (int i = count + (count % 2); i < 512; i += 2)
-    data_port.write(0x0000); // Write zero to complete the sector.
-    
-  // Wait for the device to complete the operation or for an interrupt.
-  // We'll poll for now but the interrupt handler will also be called.
-  status = command_port.read();
-  int timeout = 1000000; // Timeout counter to prevent infinite loop
-  while ((status & 0x80) && !(status & 0x01) && timeout > 0) {
-      status = command_port.read();
-      timeout--;
+// read_sectors28(): Reads up to 256 whole sectors below 128 GiB.
+bool ATA::read_sectors28(uint32_t sector_num, uint8_t *data,
+                         uint32_t sector_count) {
+  if (data == nullptr || sector_count == 0 ||
+      sector_count > ATA_MAX_SECTORS_PER_COMMAND)
+    return false;
+  if (sector_num + sector_count - 1 > 0x0FFFFFFF) {
+    libc::printf("ERROR: Sector number out of range.\n");
+    return false;
   }
+  return transfer(sector_num, data, sector_count, false, false);
+}
 
-  if (timeout <= 0) {
-      libc::printf("ERROR: Write operation timed out.\n");
-      return;
+// write_sectors28(): Writes up to 256 whole sectors below 128 GiB.
+bool ATA::write_sectors28(uint32_t sector_num, uint8_t *data,
+                          uint32_t sector_count) {
+  if (data == nullptr || sector_count == 0 ||
+      sector_count > ATA_MAX_SECTORS_PER_COMMAND)
+    return false;
+  if (sector_num + sector_count - 1 > 0x0FFFFFFF) {
+    libc::printf("ERROR: Sector number out of range.\n");
+    return false;
   }
+  return transfer(sector_num, data, sector_count, true, false);
+}
 
-  if (status & 0x01) { // If an error occurred...
-      uint8_t error_code = error_port.read();
-      libc::printf("ERROR: Write failed. Error code: 0x%x\n", error_code);
-      return;
+// read48(): Reads up to 65536 whole sectors anywhere on an LBA48 drive.
+bool ATA::read48(uint64_t sector_num, uint8_t *data, uint32_t sector_count) {
+  if (!info.lba48) {
+    libc::printf("ERROR: Device does not support 48-bit LBA.\n");
+    return false;
+  }
+  if (data == nullptr || sector_count == 0 ||
+      sector_count > ATA_MAX_SECTORS_PER_COMMAND48)
+    return false;
+  if (sector_num + sector_count > info.sector_count) {
+    libc::printf("ERROR: Sector number out of range.\n");
+    return false;
   }
+  return transfer(sector_num, data, sector_count, false, true);
 }
 
-// flush(): Flushes the ATA device's write cache.
-void ATA::flush() {
-  device_port.write(master ? 0xE0
-                           : 0xF0); // Select the device (master or slave).
-  command_port.write(0xE7);         // Send the FLUSH command (0xE7).
-  uint8_t status =
-      command_port.read(); // Read the status after the flush command.
-  if (status == 0x00)      // If status indicates no activity, return.
-    return;
-
-  // Wait until the device is ready (not busy) and check for errors.
-  while (((status & 0x80) == 0x80) && ((status & 0x01) != 0x01))
-    status = command_port.read();
+// write48(): Writes up to 65536 whole sectors anywhere on an LBA48 drive.
+bool ATA::write48(uint64_t sector_num, uint8_t *data, uint32_t sector_count) {
+  if (!info.lba48) {
+    libc::printf("ERROR: Device does not support 48-bit LBA.\n");
+    return false;
+  }
+  if (data == nullptr || sector_count == 0 ||
+      sector_count > ATA_MAX_SECTORS_PER_COMMAND48)
+    return false;
+  if (sector_num + sector_count > info.sector_count) {
+    libc::printf("ERROR: Sector number out of range.\n");
+    return false;
+  }
+  return transfer(sector_num, data, sector_count, true, true);
+}
 
-  if (status & 0x01) {     // If an error occurred...
-    libc::printf("ERROR"); // ...print an error message.
-    return;
+// read_sectors(): Picks the shorter 28-bit command when the range allows
+// it and the 48-bit one otherwise.
+bool ATA::read_sectors(uint64_t sector_num, uint8_t *data,
+                       uint32_t sector_count) {
+  if (sector_count <= ATA_MAX_SECTORS_PER_COMMAND &&
+      sector_num + sector_count <= 0x10000000)
+    return read_sectors28((uint32_t)sector_num, data, sector_count);
+  return read48(sector_num, data, sector_count);
+}
+
+bool ATA::write_sectors(uint64_t sector_num, uint8_t *data,
+                        uint32_t sector_count) {
+  if (sector_count <= ATA_MAX_SECTORS_PER_COMMAND &&
+      sector_num + sector_count <= 0x10000000)
+    return write_sectors28((uint32_t)sector_num, data, sector_count);
+  return write48(sector_num, data, sector_count);
+}
+
+// max_sectors_per_command(): Largest sector_count read_sectors accepts.
+uint32_t ATA::max_sectors_per_command() {
+  return info.lba48 ? ATA_MAX_SECTORS_PER_COMMAND48
+                    : ATA_MAX_SECTORS_PER_COMMAND;
+}
+
+// read_blocks()/write_blocks(): BlockDevice access, any number of sectors,
+// split at max_blocks_per_request().
+bool ATA::read_blocks(uint64_t lba, uint8_t *buffer, uint32_t count) {
+  uint32_t limit = max_blocks_per_request();
+  while (count > 0) {
+    uint32_t run = count < limit ? count : limit;
+    if (!read_sectors(lba, buffer, run))
+      return false;
+    lba += run;
+    buffer += run * 512;
+    count -= run;
+  }
+  return true;
+}
+
+bool ATA::write_blocks(uint64_t lba, uint8_t *buffer, uint32_t count) {
+  uint32_t limit = max_blocks_per_request();
+  while (count > 0) {
+    uint32_t run = count < limit ? count : limit;
+    if (!write_sectors(lba, buffer, run))
+      return false;
+    lba += run;
+    buffer += run * 512;
+    count -= run;
   }
+  return true;
+}
+
+uint64_t ATA::block_count() { return info.sector_count; }
+
+// max_blocks_per_request(): With a DMA engine attached, no more than one PRD
+// table can describe; a longer command would go by PIO instead.
+uint32_t ATA::max_blocks_per_request() {
+  uint32_t limit = max_sectors_per_command();
+  if (dma != 0 && limit > IDE_DMA_MAX_SECTORS)
+    limit = IDE_DMA_MAX_SECTORS;
+  return limit;
+}
+
+// flush(): Flushes the ATA device's write cache. Flushing can take a long
+// time, so the caller sleeps until IRQ 14 like for a transfer.
+bool ATA::flush() {
+  if (wait_not_busy() & ATA_STATUS_BSY)
+    return false;
+
+  // FLUSH CACHE EXT (0xEA) covers the whole of an LBA48 drive's cache.
+  issue_command28(info.lba48 ? 0xEA : 0xE7, 0, 0);
+  return check_status(wait_for_interrupt(), false, "Flush");
 }
 
 } // namespace driver
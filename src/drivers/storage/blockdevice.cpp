@@ -0,0 +1,68 @@
+#include "../../include/drivers/storage/blockdevice.h"
+
+namespace uqaabOS {
+namespace driver {
+
+BlockRequest::BlockRequest() {
+  lba = 0;
+  buffer = 0;
+  sector_count = 0;
+  write = false;
+  callback = 0;
+  context = 0;
+  done = false;
+  success = false;
+  next = 0;
+}
+
+BlockRequest::BlockRequest(uint64_t lba, uint8_t *buffer, uint32_t sector_count,
+                           bool write, BlockRequestCallback callback,
+                           void *context) {
+  this->lba = lba;
+  this->buffer = buffer;
+  this->sector_count = sector_count;
+  this->write = write;
+  this->callback = callback;
+  this->context = context;
+  done = false;
+  success = false;
+  next = 0;
+}
+
+// The base class is an empty device; every implementation overrides these.
+// They cannot be pure virtual: the kernel has no __cxa_pure_virtual.
+BlockDevice::BlockDevice() {}
+
+BlockDevice::~BlockDevice() {}
+
+bool BlockDevice::read_blocks(uint64_t, uint8_t *, uint32_t) {
+  return false;
+}
+
+bool BlockDevice::write_blocks(uint64_t, uint8_t *, uint32_t) {
+  return false;
+}
+
+bool BlockDevice::flush() { return true; }
+
+uint64_t BlockDevice::block_count() { return 0; }
+
+uint32_t BlockDevice::max_blocks_per_request() { return 0xFFFFFFFF; }
+
+// Devices without a queue complete the request before returning.
+void BlockDevice::submit(BlockRequest *request) {
+  request->success =
+      request->write
+          ? write_blocks(request->lba, request->buffer, request->sector_count)
+          : read_blocks(request->lba, request->buffer, request->sector_count);
+  request->done = true;
+  if (request->callback != 0)
+    request->callback(request);
+}
+
+bool BlockDevice::wait(BlockRequest *request) {
+  return request->done && request->success;
+}
+
+} // namespace driver
+} // namespace uqaabOS
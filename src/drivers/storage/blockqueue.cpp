@@ -0,0 +1,282 @@
+#include "../../include/drivers/storage/blockqueue.h"
+#include "../../include/interrupts.h"
+#include "../../include/libc/string.h"
+#include "../../include/memorymanagement/memorymanagement.h"
+
+namespace uqaabOS {
+namespace driver {
+
+BlockRequestQueue::BlockRequestQueue(BlockDevice *disk) {
+  this->disk = disk;
+  pending = 0;
+  head_position = 0;
+  dispatching = false;
+  worker_running = false;
+  stats.requests = 0;
+  stats.commands = 0;
+  stats.merged_requests = 0;
+  stats.bounced_commands = 0;
+
+  // Without a bounce buffer, only requests with contiguous buffers merge
+  merge_buffer = 0;
+  if (memorymanagement::MemoryManager::active_memory_manager != 0)
+    merge_buffer =
+        (uint8_t *)memorymanagement::MemoryManager::active_memory_manager
+            ->malloc_aligned(BLOCK_QUEUE_MAX_MERGE_SECTORS * 512, 16);
+}
+
+BlockRequestQueue::~BlockRequestQueue() {
+  if (merge_buffer != 0)
+    memorymanagement::MemoryManager::active_memory_manager->free(merge_buffer);
+}
+
+/* Submission
+ * Inserts the request after every pending one with a lower or equal LBA,
+ * so same-sector requests keep their submission order. */
+void BlockRequestQueue::enqueue(BlockRequest *request, bool wake_worker) {
+  request->done = false;
+  request->success = false;
+
+  uint32_t flags = multitasking::disable_interrupts();
+  BlockRequest **link = &pending;
+  while (*link != 0 && (*link)->lba <= request->lba)
+    link = &(*link)->next;
+  request->next = *link;
+  *link = request;
+  stats.requests++;
+
+  if (wake_worker && worker_running &&
+      multitasking::TaskManager::active_task_manager != 0)
+    multitasking::TaskManager::active_task_manager->wake_up(&work_queue);
+  multitasking::restore_interrupts(flags);
+}
+
+void BlockRequestQueue::submit(BlockRequest *request) {
+  enqueue(request, true);
+}
+
+void BlockRequestQueue::complete(BlockRequest *request, bool success) {
+  request->success = success;
+  request->done = true;
+  if (request->callback != 0)
+    request->callback(request);
+}
+
+/* Dispatch
+ * C-LOOK: serve the lowest pending LBA at or above head_position, or wrap
+ * to the lowest LBA overall. The chosen request absorbs the requests that
+ * follow it on disk, as long as they go the same way and fit one command.
+ * @return: false if nothing was pending */
+bool BlockRequestQueue::dispatch_next() {
+  uint32_t flags = multitasking::disable_interrupts();
+  if (pending == 0) {
+    multitasking::restore_interrupts(flags);
+    return false;
+  }
+
+  BlockRequest **first_link = &pending;
+  while (*first_link != 0 && (*first_link)->lba < head_position)
+    first_link = &(*first_link)->next;
+  if (*first_link == 0)
+    first_link = &pending; // Nothing ahead of the head: wrap around
+
+  BlockRequest *first = *first_link;
+  BlockRequest *last = first;
+  uint64_t end = first->lba + first->sector_count;
+  uint32_t total = first->sector_count;
+  uint32_t count = 1;
+  bool contiguous = true;
+  uint32_t merge_limit =
+      merge_buffer != 0 ? BLOCK_QUEUE_MAX_MERGE_SECTORS : disk->max_blocks_per_request();
+
+  while (last->next != 0 && last->next->write == first->write &&
+         last->next->lba == end &&
+         total + last->next->sector_count <= merge_limit) {
+    BlockRequest *candidate = last->next;
+    bool follows = candidate->buffer == last->buffer + last->sector_count * 512;
+    if (!follows && merge_buffer == 0)
+      break;
+    contiguous = contiguous && follows;
+    last = candidate;
+    end += candidate->sector_count;
+    total += candidate->sector_count;
+    count++;
+  }
+
+  // Unlink the batch; it stays chained through 'next'
+  *first_link = last->next;
+  last->next = 0;
+  head_position = end;
+  multitasking::restore_interrupts(flags);
+
+  bool success;
+  if (contiguous) {
+    success = first->write ? disk->write_blocks(first->lba, first->buffer, total)
+                           : disk->read_blocks(first->lba, first->buffer, total);
+  } else {
+    // Gather writes into / scatter reads out of the bounce buffer
+    stats.bounced_commands++;
+    if (first->write) {
+      uint8_t *position = merge_buffer;
+      for (BlockRequest *request = first; request != 0; request = request->next) {
+        libc::memcpy(position, request->buffer, request->sector_count * 512);
+        position += request->sector_count * 512;
+      }
+    }
+    success = first->write ? disk->write_blocks(first->lba, merge_buffer, total)
+                           : disk->read_blocks(first->lba, merge_buffer, total);
+    if (success && !first->write) {
+      uint8_t *position = merge_buffer;
+      for (BlockRequest *request = first; request != 0; request = request->next) {
+        libc::memcpy(request->buffer, position, request->sector_count * 512);
+        position += request->sector_count * 512;
+      }
+    }
+  }
+  stats.commands++;
+  stats.merged_requests += count - 1;
+
+  BlockRequest *request = first;
+  while (request != 0) {
+    BlockRequest *next = request->next;
+    request->next = 0;
+    complete(request, success);
+    request = next;
+  }
+
+  if (multitasking::TaskManager::active_task_manager != 0)
+    multitasking::TaskManager::active_task_manager->wake_up(&completion_queue);
+  return true;
+}
+
+/* Waiting
+ * While the worker or another task is dispatching, sleep until the next
+ * completion. Otherwise dispatch in this task, in elevator order, until
+ * the request is done; a caller with nothing else queued thus runs its own
+ * request without a switch to the worker. */
+bool BlockRequestQueue::wait(BlockRequest *request) {
+  multitasking::TaskManager *task_manager =
+      multitasking::TaskManager::active_task_manager;
+
+  uint32_t flags = multitasking::disable_interrupts();
+  while (!request->done) {
+    if (dispatching && task_manager != 0 &&
+        !interrupts::InterruptManager::in_interrupt()) {
+      task_manager->sleep_on(&completion_queue);
+      continue;
+    }
+
+    dispatching = true;
+    multitasking::restore_interrupts(flags);
+    bool dispatched = true;
+    while (!request->done && dispatched)
+      dispatched = dispatch_next();
+    flags = multitasking::disable_interrupts();
+    end_dispatch();
+
+    if (!dispatched)
+      break; // Never submitted
+  }
+  multitasking::restore_interrupts(flags);
+  return request->done && request->success;
+}
+
+/* Draining
+ * Returns once nothing is pending or in flight, whoever dispatches it. */
+void BlockRequestQueue::drain() {
+  multitasking::TaskManager *task_manager =
+      multitasking::TaskManager::active_task_manager;
+
+  uint32_t flags = multitasking::disable_interrupts();
+  while (pending != 0 || dispatching) {
+    if (dispatching) {
+      if (task_manager == 0 || interrupts::InterruptManager::in_interrupt())
+        break; // Cannot wait for the dispatcher here
+      task_manager->sleep_on(&completion_queue);
+      continue;
+    }
+
+    dispatching = true;
+    multitasking::restore_interrupts(flags);
+    while (dispatch_next())
+      ;
+    flags = multitasking::disable_interrupts();
+    end_dispatch();
+  }
+  multitasking::restore_interrupts(flags);
+}
+
+// Called with interrupts disabled when a task stops dispatching: wakes
+// waiters that slept because the queue was busy, and the worker if there
+// is work left.
+void BlockRequestQueue::end_dispatch() {
+  dispatching = false;
+  multitasking::TaskManager *task_manager =
+      multitasking::TaskManager::active_task_manager;
+  if (task_manager == 0)
+    return;
+  task_manager->wake_up(&completion_queue);
+  if (worker_running && pending != 0)
+    task_manager->wake_up(&work_queue);
+}
+
+bool BlockRequestQueue::read(uint64_t lba, uint8_t *buffer,
+                             uint32_t sector_count) {
+  BlockRequest request(lba, buffer, sector_count, false);
+  enqueue(&request, false);
+  return wait(&request);
+}
+
+bool BlockRequestQueue::write(uint64_t lba, uint8_t *buffer,
+                              uint32_t sector_count) {
+  BlockRequest request(lba, buffer, sector_count, true);
+  enqueue(&request, false);
+  return wait(&request);
+}
+
+void BlockRequestQueue::run() {
+  multitasking::TaskManager *task_manager =
+      multitasking::TaskManager::active_task_manager;
+
+  uint32_t flags = multitasking::disable_interrupts();
+  worker_running = true;
+  while (true) {
+    while (pending == 0 || dispatching)
+      task_manager->sleep_on(&work_queue);
+    dispatching = true;
+    multitasking::restore_interrupts(flags);
+
+    while (dispatch_next())
+      ;
+
+    flags = multitasking::disable_interrupts();
+    end_dispatch();
+  }
+}
+
+bool BlockRequestQueue::read_blocks(uint64_t lba, uint8_t *buffer,
+                                    uint32_t count) {
+  return read(lba, buffer, count);
+}
+
+bool BlockRequestQueue::write_blocks(uint64_t lba, uint8_t *buffer,
+                                     uint32_t count) {
+  return write(lba, buffer, count);
+}
+
+bool BlockRequestQueue::flush() {
+  // Writes submitted earlier reach the drive before FLUSH CACHE
+  drain();
+  return disk->flush();
+}
+
+uint64_t BlockRequestQueue::block_count() { return disk->block_count(); }
+
+uint32_t BlockRequestQueue::max_blocks_per_request() {
+  return disk->max_blocks_per_request();
+}
+
+BlockQueueStatistics BlockRequestQueue::statistics() { return stats; }
+
+} // namespace driver
+} // namespace uqaabOS
@@ -0,0 +1,555 @@
+#include "../../include/drivers/storage/buffercache.h"
+#include "../../include/interrupts.h"
+#include "../../include/libc/stdio.h"
+#include "../../include/libc/string.h"
+#include "../../include/memorymanagement/memorymanagement.h"
+
+namespace uqaabOS {
+namespace driver {
+
+BufferCache *BufferCache::active_cache = 0;
+
+BufferCache::BufferCache(BlockDevice *disk, uint32_t capacity) {
+  this->disk = disk;
+  this->capacity = 0;
+  buffers = 0;
+  block_memory = 0;
+  hash_table = 0;
+  hash_mask = 0;
+  lru_head = 0;
+  lru_tail = 0;
+  stats.hits = 0;
+  stats.misses = 0;
+  stats.evictions = 0;
+  stats.bypassed = 0;
+  stats.coalesced = 0;
+  stats.written_back = 0;
+  stats.writeback_requests = 0;
+  write_back = false;
+  dirty_list = 0;
+  dirty_count = 0;
+  writeback_buffer = 0;
+  busy = false;
+  active_cache = this;
+
+  memorymanagement::MemoryManager *heap =
+      memorymanagement::MemoryManager::active_memory_manager;
+  if (heap == 0 || capacity == 0)
+    return;
+
+  // About two buffers per bucket
+  uint32_t buckets = 1;
+  while (buckets * 2 < capacity)
+    buckets <<= 1;
+
+  buffers = (CacheBuffer *)heap->malloc_aligned(capacity * sizeof(CacheBuffer), 16);
+  block_memory = (uint8_t *)heap->malloc_aligned(capacity * BLOCK_SIZE, 16);
+  hash_table =
+      (CacheBuffer **)heap->malloc_aligned(buckets * sizeof(CacheBuffer *), 16);
+  if (buffers == 0 || block_memory == 0 || hash_table == 0) {
+    if (buffers != 0)
+      heap->free(buffers);
+    if (block_memory != 0)
+      heap->free(block_memory);
+    if (hash_table != 0)
+      heap->free(hash_table);
+    buffers = 0;
+    block_memory = 0;
+    hash_table = 0;
+    return;
+  }
+
+  this->capacity = capacity;
+  hash_mask = buckets - 1;
+  for (uint32_t i = 0; i < buckets; i++)
+    hash_table[i] = 0;
+
+  // All buffers start invalid, chained in LRU order
+  for (uint32_t i = 0; i < capacity; i++) {
+    buffers[i].lba = 0;
+    buffers[i].data = block_memory + i * BLOCK_SIZE;
+    buffers[i].valid = false;
+    buffers[i].dirty = false;
+    buffers[i].dirty_next = 0;
+    buffers[i].hash_next = 0;
+    buffers[i].lru_prev = i > 0 ? &buffers[i - 1] : 0;
+    buffers[i].lru_next = i + 1 < capacity ? &buffers[i + 1] : 0;
+  }
+  lru_head = &buffers[0];
+  lru_tail = &buffers[capacity - 1];
+
+  // Without it, dirty blocks are written back one request each
+  writeback_buffer = (uint8_t *)heap->malloc_aligned(
+      BUFFER_CACHE_WRITEBACK_BLOCKS * BLOCK_SIZE, 16);
+}
+
+BufferCache::~BufferCache() {
+  if (active_cache == this)
+    active_cache = 0;
+  if (capacity == 0)
+    return;
+  memorymanagement::MemoryManager *heap =
+      memorymanagement::MemoryManager::active_memory_manager;
+  heap->free(buffers);
+  heap->free(block_memory);
+  heap->free(hash_table);
+  if (writeback_buffer != 0)
+    heap->free(writeback_buffer);
+}
+
+// A sleeping lock: the holder may block on the device. A holder that is
+// busy is never overridden. Interrupt handlers cannot wait for it, so they
+// are refused; before multitasking starts the caller spins with interrupts
+// enabled, since only a handler can be holding it then.
+bool BufferCache::lock() {
+  multitasking::TaskManager *task_manager =
+      multitasking::TaskManager::active_task_manager;
+
+  uint32_t flags = multitasking::disable_interrupts();
+  while (busy) {
+    if (interrupts::InterruptManager::in_interrupt() || !(flags & 0x200)) {
+      multitasking::restore_interrupts(flags);
+      libc::printf("Buffer cache: busy, request refused\n");
+      return false;
+    }
+    if (task_manager != 0)
+      task_manager->sleep_on(&lock_queue);
+    else
+      asm volatile("sti; pause; cli");
+  }
+  busy = true;
+  multitasking::restore_interrupts(flags);
+  return true;
+}
+
+void BufferCache::unlock() {
+  uint32_t flags = multitasking::disable_interrupts();
+  busy = false;
+  if (multitasking::TaskManager::active_task_manager != 0)
+    multitasking::TaskManager::active_task_manager->wake_up(&lock_queue);
+  multitasking::restore_interrupts(flags);
+}
+
+// Neighbouring LBAs land in neighbouring buckets; the multiplier spreads
+// the high bits of large partitions over the table.
+uint32_t BufferCache::hash(uint64_t lba) {
+  uint32_t key = (uint32_t)lba ^ (uint32_t)(lba >> 32);
+  return (key ^ ((key >> 16) * 0x9E37)) & hash_mask;
+}
+
+CacheBuffer *BufferCache::lookup(uint64_t lba) {
+  for (CacheBuffer *buffer = hash_table[hash(lba)]; buffer != 0;
+       buffer = buffer->hash_next)
+    if (buffer->lba == lba)
+      return buffer;
+  return 0;
+}
+
+void BufferCache::unhash(CacheBuffer *buffer) {
+  CacheBuffer **link = &hash_table[hash(buffer->lba)];
+  while (*link != 0 && *link != buffer)
+    link = &(*link)->hash_next;
+  if (*link != 0)
+    *link = buffer->hash_next;
+  buffer->hash_next = 0;
+  buffer->valid = false;
+}
+
+void BufferCache::move_to_head(CacheBuffer *buffer) {
+  if (buffer == lru_head)
+    return;
+  // Unlink; it is not the head, so it has a predecessor
+  buffer->lru_prev->lru_next = buffer->lru_next;
+  if (buffer->lru_next != 0)
+    buffer->lru_next->lru_prev = buffer->lru_prev;
+  else
+    lru_tail = buffer->lru_prev;
+
+  buffer->lru_prev = 0;
+  buffer->lru_next = lru_head;
+  lru_head->lru_prev = buffer;
+  lru_head = buffer;
+}
+
+void BufferCache::move_to_tail(CacheBuffer *buffer) {
+  if (buffer == lru_tail)
+    return;
+  if (buffer->lru_prev != 0)
+    buffer->lru_prev->lru_next = buffer->lru_next;
+  else
+    lru_head = buffer->lru_next;
+  buffer->lru_next->lru_prev = buffer->lru_prev;
+
+  buffer->lru_next = 0;
+  buffer->lru_prev = lru_tail;
+  lru_tail->lru_next = buffer;
+  lru_tail = buffer;
+}
+
+void BufferCache::mark_dirty(CacheBuffer *buffer) {
+  if (buffer->dirty) {
+    stats.coalesced++;
+    return;
+  }
+  CacheBuffer **link = &dirty_list;
+  while (*link != 0 && (*link)->lba < buffer->lba)
+    link = &(*link)->dirty_next;
+  buffer->dirty_next = *link;
+  *link = buffer;
+  buffer->dirty = true;
+  dirty_count++;
+}
+
+void BufferCache::unlink_dirty(CacheBuffer *buffer) {
+  if (!buffer->dirty)
+    return;
+  CacheBuffer **link = &dirty_list;
+  while (*link != 0 && *link != buffer)
+    link = &(*link)->dirty_next;
+  if (*link != 0)
+    *link = buffer->dirty_next;
+  buffer->dirty_next = 0;
+  buffer->dirty = false;
+  dirty_count--;
+}
+
+// Forgets the buffer's block, dirty or not, and queues it for reuse.
+void BufferCache::discard(CacheBuffer *buffer) {
+  unlink_dirty(buffer);
+  unhash(buffer);
+  move_to_tail(buffer);
+}
+
+CacheBuffer *BufferCache::insert(uint64_t lba, const uint8_t *data) {
+  CacheBuffer *buffer = lookup(lba);
+  if (buffer == 0) {
+    buffer = lru_tail;
+    // Cache pressure: the oldest buffer still has to reach the disk. Write
+    // back all dirty blocks together rather than this one alone.
+    if (buffer->dirty && (!write_back_dirty() || buffer->dirty))
+      return 0;
+    if (buffer->valid) {
+      unhash(buffer);
+      stats.evictions++;
+    }
+    buffer->lba = lba;
+    buffer->valid = true;
+    uint32_t bucket = hash(lba);
+    buffer->hash_next = hash_table[bucket];
+    hash_table[bucket] = buffer;
+  }
+  libc::memcpy(buffer->data, data, BLOCK_SIZE);
+  move_to_head(buffer);
+  return buffer;
+}
+
+/* Write-back
+ * Walks the LBA-sorted dirty list. Runs of consecutive LBAs are gathered
+ * into writeback_buffer, one request per run, until it is full. The batch
+ * is submitted as a whole and waited for once, so a request queue below
+ * can sort the runs and merge the ones that meet. The FAT sectors touched
+ * while a file grows thus leave the cache as a few long writes. */
+bool BufferCache::write_back_dirty() {
+  bool success = true;
+  CacheBuffer **link = &dirty_list;
+  while (*link != 0) {
+    // Without a gather buffer, every block is a run of its own
+    uint32_t batched = 0;
+    uint32_t gathered = 0;
+    for (CacheBuffer *first = *link;
+         first != 0 && batched < BUFFER_CACHE_WRITEBACK_BLOCKS &&
+         gathered < BUFFER_CACHE_WRITEBACK_BLOCKS;
+         batched++) {
+      CacheBuffer *last = first;
+      uint32_t run = 1;
+      uint8_t *source = first->data;
+      if (writeback_buffer != 0) {
+        source = writeback_buffer + gathered * BLOCK_SIZE;
+        libc::memcpy(source, first->data, BLOCK_SIZE);
+        while (last->dirty_next != 0 &&
+               last->dirty_next->lba == last->lba + 1 &&
+               gathered + run < BUFFER_CACHE_WRITEBACK_BLOCKS) {
+          last = last->dirty_next;
+          libc::memcpy(source + run * BLOCK_SIZE, last->data, BLOCK_SIZE);
+          run++;
+        }
+        gathered += run;
+      }
+      writeback_batch[batched] = BlockRequest(first->lba, source, run, true);
+      disk->submit(&writeback_batch[batched]);
+      first = last->dirty_next;
+    }
+
+    // The runs are still first on the dirty list, in the same order
+    for (uint32_t i = 0; i < batched; i++) {
+      CacheBuffer *first = *link;
+      CacheBuffer *last = first;
+      uint32_t run = writeback_batch[i].sector_count;
+      for (uint32_t j = 1; j < run; j++)
+        last = last->dirty_next;
+      stats.writeback_requests++;
+
+      if (!disk->wait(&writeback_batch[i])) {
+        libc::printf("Buffer cache: write-back of block %x failed\n",
+                     (uint32_t)first->lba);
+        success = false;
+        link = &last->dirty_next; // Keep the run dirty, go on with the rest
+        continue;
+      }
+
+      // Unlink the run
+      *link = last->dirty_next;
+      CacheBuffer *buffer = first;
+      for (uint32_t j = 0; j < run; j++) {
+        CacheBuffer *next = buffer->dirty_next;
+        buffer->dirty = false;
+        buffer->dirty_next = 0;
+        buffer = next;
+      }
+      dirty_count -= run;
+      stats.written_back += run;
+    }
+  }
+  return success;
+}
+
+/* Reads
+ * Cached blocks are copied out; each run of missing blocks is read from the
+ * device in one request, straight into the caller's buffer, and then copied
+ * into the cache. Runs longer than a quarter of the cache (large file
+ * reads) are not kept, so they cannot flush the metadata out of it. */
+bool BufferCache::read_blocks(uint64_t lba, uint8_t *buffer, uint32_t count) {
+  if (capacity == 0)
+    return disk->read_blocks(lba, buffer, count);
+
+  if (!lock())
+    return false;
+  uint32_t i = 0;
+  while (i < count) {
+    CacheBuffer *cached = lookup(lba + i);
+    if (cached != 0) {
+      libc::memcpy(buffer + i * BLOCK_SIZE, cached->data, BLOCK_SIZE);
+      move_to_head(cached);
+      stats.hits++;
+      i++;
+      continue;
+    }
+
+    uint32_t run = 1;
+    while (i + run < count && lookup(lba + i + run) == 0)
+      run++;
+    stats.misses += run;
+
+    uint8_t *destination = buffer + i * BLOCK_SIZE;
+    if (!disk->read_blocks(lba + i, destination, run)) {
+      unlock();
+      return false;
+    }
+
+    if (run > capacity / 4) {
+      stats.bypassed += run;
+    } else {
+      for (uint32_t j = 0; j < run; j++)
+        insert(lba + i + j, destination + j * BLOCK_SIZE);
+    }
+    i += run;
+  }
+  unlock();
+  return true;
+}
+
+/* Writes
+ * Write-through: the device is written first, then cached copies of the
+ * blocks are refreshed. Short writes are cached too, since FAT and
+ * directory sectors are usually read again right after being written.
+ *
+ * Write-back: short writes only update the cache and mark the blocks
+ * dirty; a block that gets no buffer is written through. Long writes still
+ * go straight to the device. Once half the cache is dirty, it is all
+ * written back. */
+bool BufferCache::write_blocks(uint64_t lba, uint8_t *buffer, uint32_t count) {
+  if (capacity == 0)
+    return disk->write_blocks(lba, buffer, count);
+
+  if (!lock())
+    return false;
+  bool keep = count <= capacity / 4;
+  bool success = true;
+
+  if (write_back && keep) {
+    for (uint32_t i = 0; i < count; i++) {
+      uint8_t *data = buffer + i * BLOCK_SIZE;
+      CacheBuffer *cached = insert(lba + i, data);
+      if (cached != 0)
+        mark_dirty(cached);
+      else if (!disk->write_blocks(lba + i, data, 1))
+        success = false;
+    }
+    if (dirty_count > capacity / 2 && !write_back_dirty())
+      success = false;
+    unlock();
+    return success;
+  }
+
+  if (!disk->write_blocks(lba, buffer, count)) {
+    // The device may hold either version now; forget ours
+    for (uint32_t i = 0; i < count; i++) {
+      CacheBuffer *cached = lookup(lba + i);
+      if (cached != 0)
+        discard(cached);
+    }
+    unlock();
+    return false;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    CacheBuffer *cached = lookup(lba + i);
+    if (cached != 0) {
+      // Now matches the device
+      libc::memcpy(cached->data, buffer + i * BLOCK_SIZE, BLOCK_SIZE);
+      unlink_dirty(cached);
+      move_to_head(cached);
+    } else if (keep) {
+      insert(lba + i, buffer + i * BLOCK_SIZE);
+    }
+  }
+  unlock();
+  return true;
+}
+
+/* Asynchronous requests
+ * A write the cache would hand to the device anyway (write-through, or
+ * too long to keep) is passed on to the device's queue after the cached
+ * copies of its blocks are refreshed, so batches from the filesystem reach
+ * the queue together. Everything else is done at once by write_blocks or
+ * read_blocks. */
+void BufferCache::submit(BlockRequest *request) {
+  if (capacity == 0) {
+    disk->submit(request);
+    return;
+  }
+  bool keep = request->sector_count <= capacity / 4;
+  if (!request->write || (write_back && keep) || !lock()) {
+    BlockDevice::submit(request);
+    return;
+  }
+
+  for (uint32_t i = 0; i < request->sector_count; i++) {
+    uint8_t *data = request->buffer + i * BLOCK_SIZE;
+    CacheBuffer *cached = lookup(request->lba + i);
+    if (cached != 0) {
+      libc::memcpy(cached->data, data, BLOCK_SIZE);
+      unlink_dirty(cached);
+      move_to_head(cached);
+    } else if (keep) {
+      insert(request->lba + i, data);
+    }
+  }
+  unlock();
+  disk->submit(request);
+}
+
+// A failed write may have left either version on the device, so clean
+// cached copies of its blocks are dropped. Dirty ones were written since
+// and are kept.
+bool BufferCache::wait(BlockRequest *request) {
+  if (disk->wait(request))
+    return true;
+  if (capacity != 0 && request->write && request->done && lock()) {
+    for (uint32_t i = 0; i < request->sector_count; i++) {
+      CacheBuffer *cached = lookup(request->lba + i);
+      if (cached != 0 && !cached->dirty)
+        discard(cached);
+    }
+    unlock();
+  }
+  return false;
+}
+
+bool BufferCache::flush() {
+  bool success = sync();
+  return disk->flush() && success;
+}
+
+uint64_t BufferCache::block_count() { return disk->block_count(); }
+
+uint32_t BufferCache::max_blocks_per_request() {
+  return disk->max_blocks_per_request();
+}
+
+void BufferCache::set_write_back(bool enabled) {
+  if (!lock())
+    return;
+  if (!enabled)
+    write_back_dirty();
+  write_back = enabled && capacity != 0;
+  unlock();
+}
+
+bool BufferCache::is_write_back() { return write_back; }
+
+bool BufferCache::sync() {
+  if (dirty_count == 0)
+    return true;
+  if (!lock())
+    return false;
+  bool success = write_back_dirty();
+  unlock();
+  return success;
+}
+
+void BufferCache::run_flusher() {
+  multitasking::TaskManager *task_manager =
+      multitasking::TaskManager::active_task_manager;
+  while (true) {
+    task_manager->sleep(BUFFER_CACHE_FLUSH_INTERVAL_MS);
+    sync();
+  }
+}
+
+void BufferCache::invalidate() {
+  if (!lock())
+    return;
+  write_back_dirty();
+  for (uint32_t i = 0; i < capacity; i++)
+    if (buffers[i].valid)
+      discard(&buffers[i]);
+  unlock();
+}
+
+uint32_t BufferCache::get_capacity() { return capacity; }
+
+uint32_t BufferCache::dirty_blocks() { return dirty_count; }
+
+BufferCacheStatistics BufferCache::statistics() { return stats; }
+
+void BufferCache::print_statistics() {
+  uint32_t cached = 0;
+  for (uint32_t i = 0; i < capacity; i++)
+    if (buffers[i].valid)
+      cached++;
+
+  uint32_t lookups = stats.hits + stats.misses;
+  // Percentage without 64-bit division; scale down first for large counts
+  uint32_t hits = stats.hits;
+  while (lookups > 0x00FFFFFF) {
+    lookups >>= 1;
+    hits >>= 1;
+  }
+  uint32_t hit_rate = lookups != 0 ? hits * 100 / lookups : 0;
+
+  libc::printf("Buffer cache: %d/%d blocks in use (%d KiB)\n", cached, capacity,
+               capacity * BLOCK_SIZE / 1024);
+  libc::printf("  hits: %d  misses: %d  hit rate: %d%%\n", stats.hits,
+               stats.misses, hit_rate);
+  libc::printf("  evictions: %d  uncached (long reads): %d\n", stats.evictions,
+               stats.bypassed);
+  libc::printf("  mode: %s  dirty: %d  coalesced writes: %d\n",
+               write_back ? "write-back" : "write-through", dirty_count,
+               stats.coalesced);
+  libc::printf("  written back: %d blocks in %d requests\n", stats.written_back,
+               stats.writeback_requests);
+}
+
+} // namespace driver
+} // namespace uqaabOS
@@ -0,0 +1,50 @@
+#include "../../include/drivers/storage/filedisk.h"
+
+// Hosted build only; see filedisk.h.
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace uqaabOS {
+namespace driver {
+
+FileBlockDevice::FileBlockDevice(const char *path, bool read_only) {
+  blocks = 0;
+  fd = ::open(path, read_only ? O_RDONLY : O_RDWR);
+  if (fd < 0)
+    return;
+
+  struct stat info;
+  if (::fstat(fd, &info) == 0)
+    blocks = (uint64_t)info.st_size / BLOCK_SIZE;
+}
+
+FileBlockDevice::~FileBlockDevice() {
+  if (fd >= 0)
+    ::close(fd);
+}
+
+bool FileBlockDevice::is_open() { return fd >= 0; }
+
+bool FileBlockDevice::read_blocks(uint64_t lba, uint8_t *buffer,
+                                  uint32_t count) {
+  if (fd < 0 || buffer == 0 || lba + count > blocks)
+    return false;
+  size_t size = (size_t)count * BLOCK_SIZE;
+  return ::pread(fd, buffer, size, (off_t)(lba * BLOCK_SIZE)) == (ssize_t)size;
+}
+
+bool FileBlockDevice::write_blocks(uint64_t lba, uint8_t *buffer,
+                                   uint32_t count) {
+  if (fd < 0 || buffer == 0 || lba + count > blocks)
+    return false;
+  size_t size = (size_t)count * BLOCK_SIZE;
+  return ::pwrite(fd, buffer, size, (off_t)(lba * BLOCK_SIZE)) == (ssize_t)size;
+}
+
+bool FileBlockDevice::flush() { return fd >= 0 && ::fsync(fd) == 0; }
+
+uint64_t FileBlockDevice::block_count() { return blocks; }
+
+} // namespace driver
+} // namespace uqaabOS
@@ -0,0 +1,91 @@
+#include "../../include/drivers/storage/idedma.h"
+#include "../../include/memorymanagement/paging.h"
+
+namespace uqaabOS {
+namespace driver {
+
+// One table per channel. 512-byte alignment keeps each table inside one
+// 64 KiB region, as the controller requires.
+static PhysicalRegionDescriptor prd_tables[2][IDE_PRD_ENTRIES]
+    __attribute__((aligned(IDE_PRD_ENTRIES * sizeof(PhysicalRegionDescriptor))));
+
+// IDEBusMaster constructor: The secondary channel's registers follow the
+// primary's at offset 8.
+IDEBusMaster::IDEBusMaster(uint16_t port_base, uint8_t channel)
+    : command_port(port_base + channel * 8),
+      status_port(port_base + channel * 8 + 0x2),
+      prd_port(port_base + channel * 8 + 0x4) {
+  prd_table = prd_tables[channel & 1];
+}
+
+IDEBusMaster::~IDEBusMaster() {}
+
+uint32_t IDEBusMaster::physical_address(uint32_t virtual_address) {
+  memorymanagement::PagingManager *paging =
+      memorymanagement::PagingManager::active_paging_manager;
+  if (paging == 0 || paging->current_page_directory() == 0)
+    return virtual_address; // Paging is off: addresses are physical
+  return paging->translate(paging->current_page_directory(), virtual_address);
+}
+
+// prepare(): Describes 'buffer' page by page, merging physically contiguous
+// pages into one region as long as it stays inside a 64 KiB boundary.
+bool IDEBusMaster::prepare(uint8_t *buffer, uint32_t size, bool to_memory) {
+  uint32_t address = (uint32_t)buffer;
+  if (buffer == 0 || size == 0 || (size & 1) || (address & 1))
+    return false;
+
+  uint32_t entries = 0;
+  uint32_t region_length = 0;
+  while (size > 0) {
+    uint32_t physical = physical_address(address);
+    if (physical == 0)
+      return false;
+
+    // A chunk never crosses a page, so it never crosses 64 KiB either
+    uint32_t chunk = PAGE_SIZE - (address & (PAGE_SIZE - 1));
+    if (chunk > size)
+      chunk = size;
+
+    PhysicalRegionDescriptor *last =
+        entries > 0 ? &prd_table[entries - 1] : 0;
+    if (last != 0 && last->address + region_length == physical &&
+        (last->address & 0xFFFF0000) == ((physical + chunk - 1) & 0xFFFF0000)) {
+      region_length += chunk;
+    } else {
+      if (entries == IDE_PRD_ENTRIES)
+        return false;
+      if (last != 0)
+        last->byte_count = region_length & 0xFFFF; // 64 KiB is stored as 0
+      prd_table[entries].address = physical;
+      prd_table[entries].flags = 0;
+      region_length = chunk;
+      entries++;
+    }
+
+    address += chunk;
+    size -= chunk;
+  }
+  prd_table[entries - 1].byte_count = region_length & 0xFFFF;
+  prd_table[entries - 1].flags = IDE_PRD_END_OF_TABLE;
+
+  prd_port.write(physical_address((uint32_t)prd_table));
+  command_port.write(to_memory ? IDE_BM_COMMAND_READ : 0);
+  // Clear any stale error/interrupt from the previous transfer
+  status_port.write(IDE_BM_STATUS_ERROR | IDE_BM_STATUS_IRQ);
+  return true;
+}
+
+void IDEBusMaster::start() {
+  command_port.write(command_port.read() | IDE_BM_COMMAND_START);
+}
+
+uint8_t IDEBusMaster::stop() {
+  command_port.write(command_port.read() & ~IDE_BM_COMMAND_START);
+  uint8_t status = status_port.read();
+  status_port.write(IDE_BM_STATUS_ERROR | IDE_BM_STATUS_IRQ);
+  return status;
+}
+
+} // namespace driver
+} // namespace uqaabOS
@@ -0,0 +1,54 @@
+#include "../../include/drivers/storage/ramdisk.h"
+#include "../../include/libc/string.h"
+#include "../../include/memorymanagement/memorymanagement.h"
+
+namespace uqaabOS {
+namespace driver {
+
+RAMDisk::RAMDisk(uint32_t block_count, uint8_t *memory) {
+  this->memory = memory;
+  blocks = block_count;
+  owns_memory = false;
+
+  if (memory == 0) {
+    memorymanagement::MemoryManager *heap =
+        memorymanagement::MemoryManager::active_memory_manager;
+    this->memory =
+        heap != 0 ? (uint8_t *)heap->malloc_aligned(block_count * BLOCK_SIZE, 16)
+                  : 0;
+    if (this->memory == 0) {
+      blocks = 0;
+      return;
+    }
+    owns_memory = true;
+    libc::memset(this->memory, 0, block_count * BLOCK_SIZE);
+  }
+}
+
+RAMDisk::~RAMDisk() {
+  if (owns_memory)
+    memorymanagement::MemoryManager::active_memory_manager->free(memory);
+}
+
+bool RAMDisk::read_blocks(uint64_t lba, uint8_t *buffer, uint32_t count) {
+  if (buffer == 0 || lba + count > blocks)
+    return false;
+  libc::memcpy(buffer, memory + (uint32_t)lba * BLOCK_SIZE, count * BLOCK_SIZE);
+  return true;
+}
+
+bool RAMDisk::write_blocks(uint64_t lba, uint8_t *buffer, uint32_t count) {
+  if (buffer == 0 || lba + count > blocks)
+    return false;
+  libc::memcpy(memory + (uint32_t)lba * BLOCK_SIZE, buffer, count * BLOCK_SIZE);
+  return true;
+}
+
+bool RAMDisk::flush() { return true; }
+
+uint64_t RAMDisk::block_count() { return blocks; }
+
+uint8_t *RAMDisk::data() { return memory; }
+
+} // namespace driver
+} // namespace uqaabOS
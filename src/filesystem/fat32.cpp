@@ -4,7 +4,7 @@
 namespace uqaabOS {
 namespace filesystem {
 
-FAT32::FAT32(driver::ATA* disk, uint32_t partition_lba) {
+FAT32::FAT32(driver::BlockDevice* disk, uint32_t partition_lba) {
     this->disk = disk;
     this->partition_lba = partition_lba;
     
@@ -13,6 +13,14 @@ FAT32::FAT32(driver::ATA* disk, uint32_t partition_lba) {
     this->fat_size = 0;
     this->data_start = 0;
     this->root_cluster = 0;
+    this->fat_table = 0;
+    this->fat_entries = 0;
+    this->cluster_count = 0;
+    this->free_bitmap = 0;
+    this->free_clusters = FAT32_FSINFO_UNKNOWN;
+    this->next_free_hint = 2;
+    this->fsinfo_valid = false;
+    this->fsinfo_dirty = false;
     
     // Initialize file descriptors
     for (int i = 0; i < FAT32_MAX_OPEN_FILES; i++) {
@@ -22,12 +30,42 @@ FAT32::FAT32(driver::ATA* disk, uint32_t partition_lba) {
         file_descriptors[i].size = 0;
         file_descriptors[i].position = 0;
         file_descriptors[i].is_open = false;
+        file_descriptors[i].extents = nullptr;
+        file_descriptors[i].extent_count = 0;
+        file_descriptors[i].extent_capacity = 0;
+        file_descriptors[i].mapped_clusters = 0;
+        file_descriptors[i].extents_valid = false;
     }
+
+    // Directory code allocates and frees cluster buffers on every lookup,
+    // so keep them in their own cache instead of the general heap
+    this->cluster_buffer_cache = memorymanagement::kmem_cache_create(
+        "fat32_cluster", FAT32_CLUSTER_BUFFER_SIZE, SLAB_CACHE_LINE_SIZE);
+}
+
+uint8_t* FAT32::alloc_cluster_buffer() {
+    if (cluster_buffer_cache == 0) {
+        return new uint8_t[FAT32_CLUSTER_BUFFER_SIZE];
+    }
+    return (uint8_t*)memorymanagement::kmem_cache_alloc(cluster_buffer_cache);
+}
+
+void FAT32::free_cluster_buffer(uint8_t* buffer) {
+    if (cluster_buffer_cache == 0) {
+        delete[] buffer;
+        return;
+    }
+    memorymanagement::kmem_cache_free(cluster_buffer_cache, buffer);
 }
 
-bool FAT32::initialize() {
+bool FAT32::initialize(bool cache_fat) {
     // Read the BIOS Parameter Block from the first sector of the partition
-    disk->read28(partition_lba, (uint8_t*)&bpb, sizeof(BiosParameterBlock32));
+    uint8_t boot_sector[512];
+    if (!disk->read_blocks(partition_lba, boot_sector, 1)) {
+        libc::printf("Failed to read the FAT32 boot sector\n");
+        return false;
+    }
+    libc::memcpy(&bpb, boot_sector, sizeof(BiosParameterBlock32));
     
     // Validate BPB signature
     if (bpb.boot_signature != 0x29 && bpb.boot_signature != 0x28) {
@@ -82,6 +120,24 @@ bool FAT32::initialize() {
         return false;
     }
     
+    fat_entries = fat_size * (512 / sizeof(uint32_t));
+    if (cache_fat && !load_fat()) {
+        libc::printf("FAT not cached in memory; using disk lookups\n");
+    }
+    
+    // The FAT may have more entries than the data area has clusters
+    uint32_t total_sectors = bpb.total_sectors != 0 ? bpb.total_sectors : bpb.total_sector_count;
+    uint32_t data_sectors = total_sectors - (data_start - partition_lba);
+    cluster_count = data_sectors / bpb.sector_per_cluster + 2;
+    if (total_sectors <= data_start - partition_lba || cluster_count > fat_entries) {
+        cluster_count = fat_entries;
+    }
+    
+    read_fsinfo();
+    if (!build_free_bitmap()) {
+        libc::printf("No free-cluster bitmap; allocation scans the FAT\n");
+    }
+    
     libc::printf("FAT32 filesystem initialized successfully\n");
     libc::printf("  FAT start: ");
     libc::print_hex(fat_start);
@@ -96,6 +152,150 @@ bool FAT32::initialize() {
     return true;
 }
 
+bool FAT32::load_fat() {
+    if (fat_table != 0) {
+        return true;
+    }
+    if (fat_size > FAT32_FAT_CACHE_MAX_BYTES / 512) {
+        return false;
+    }
+    
+    fat_table = new uint32_t[fat_entries];
+    if (fat_table == 0) {
+        return false;
+    }
+    
+    // Large reads go to the disk as multi-sector commands
+    for (uint32_t sector = 0; sector < fat_size; sector += FAT32_FAT_LOAD_SECTORS) {
+        uint32_t count = fat_size - sector;
+        if (count > FAT32_FAT_LOAD_SECTORS) {
+            count = FAT32_FAT_LOAD_SECTORS;
+        }
+        if (!read_sectors(fat_start + sector, (uint8_t*)&fat_table[sector * 128], count)) {
+            libc::printf("Error: Failed to read FAT sector ");
+            libc::print_hex(sector);
+            libc::printf("\n");
+            delete[] fat_table;
+            fat_table = 0;
+            return false;
+        }
+    }
+    
+    libc::printf("  FAT cached in memory: %d KiB\n", (int)(fat_size / 2));
+    return true;
+}
+
+void FAT32::read_fsinfo() {
+    fsinfo_valid = false;
+    if (bpb.fat_info == 0 || bpb.fat_info == 0xFFFF || bpb.fat_info >= bpb.reserved_sectors) {
+        return;
+    }
+    
+    FSInfo32 fsinfo;
+    if (!read_sector(partition_lba + bpb.fat_info, (uint8_t*)&fsinfo)) {
+        return;
+    }
+    if (fsinfo.lead_signature != FAT32_FSINFO_LEAD_SIGNATURE ||
+        fsinfo.struct_signature != FAT32_FSINFO_STRUCT_SIGNATURE ||
+        fsinfo.trail_signature != FAT32_FSINFO_TRAIL_SIGNATURE) {
+        libc::printf("Invalid FSInfo signature; ignoring it\n");
+        return;
+    }
+    fsinfo_valid = true;
+    
+    // Both fields are hints; keep only plausible values
+    if (fsinfo.free_count <= cluster_count - 2) {
+        free_clusters = fsinfo.free_count;
+    }
+    if (fsinfo.next_free >= 2 && fsinfo.next_free < cluster_count) {
+        next_free_hint = fsinfo.next_free;
+    }
+}
+
+bool FAT32::write_fsinfo() {
+    if (!fsinfo_valid || !fsinfo_dirty) {
+        return true;
+    }
+    
+    FSInfo32 fsinfo;
+    if (!read_sector(partition_lba + bpb.fat_info, (uint8_t*)&fsinfo)) {
+        return false;
+    }
+    fsinfo.free_count = free_clusters;
+    fsinfo.next_free = next_free_hint;
+    if (!write_sector(partition_lba + bpb.fat_info, (uint8_t*)&fsinfo)) {
+        libc::printf("Error: Failed to write the FSInfo sector\n");
+        return false;
+    }
+    fsinfo_dirty = false;
+    return true;
+}
+
+/* Free-cluster bitmap
+ * Built from one pass over the FAT: from fat_table if it is loaded,
+ * otherwise with long reads of the FAT sectors. The exact free count it
+ * yields replaces the one from FSInfo. */
+bool FAT32::build_free_bitmap() {
+    uint32_t words = (cluster_count + 31) / 32;
+    free_bitmap = new uint32_t[words];
+    if (free_bitmap == 0) {
+        return false;
+    }
+    libc::memset(free_bitmap, 0, words * sizeof(uint32_t));
+    
+    uint32_t* chunk = 0;
+    if (fat_table == 0) {
+        chunk = new uint32_t[FAT32_FAT_LOAD_SECTORS * 128];
+        if (chunk == 0) {
+            delete[] free_bitmap;
+            free_bitmap = 0;
+            return false;
+        }
+    }
+    
+    uint32_t free_count = 0;
+    uint32_t entries_per_chunk = FAT32_FAT_LOAD_SECTORS * 128;
+    for (uint32_t first = 0; first < cluster_count; first += entries_per_chunk) {
+        uint32_t* entries = chunk;
+        if (fat_table != 0) {
+            entries = fat_table + first;
+        } else {
+            uint32_t sector = first / 128;
+            uint32_t count = fat_size - sector;
+            if (count > FAT32_FAT_LOAD_SECTORS) {
+                count = FAT32_FAT_LOAD_SECTORS;
+            }
+            if (!read_sectors(fat_start + sector, (uint8_t*)chunk, count)) {
+                libc::printf("Error: Failed to read the FAT while building the free bitmap\n");
+                delete[] chunk;
+                delete[] free_bitmap;
+                free_bitmap = 0;
+                return false;
+            }
+        }
+        
+        uint32_t last = first + entries_per_chunk;
+        if (last > cluster_count) {
+            last = cluster_count;
+        }
+        for (uint32_t cluster = first < 2 ? 2 : first; cluster < last; cluster++) {
+            if ((entries[cluster - first] & 0x0FFFFFFF) == 0) {
+                free_bitmap[cluster / 32] |= 1u << (cluster % 32);
+                free_count++;
+            }
+        }
+    }
+    if (chunk != 0) {
+        delete[] chunk;
+    }
+    
+    if (free_clusters != free_count) {
+        free_clusters = free_count;
+        fsinfo_dirty = true;
+    }
+    return true;
+}
+
 uint32_t FAT32::cluster_to_lba(uint32_t cluster) {
     // Validate cluster number
     if (cluster < 2) {
@@ -111,25 +311,25 @@ uint32_t FAT32::cluster_to_lba(uint32_t cluster) {
 }
 
 bool FAT32::read_sector(uint32_t lba, uint8_t* buffer) {
+    return read_sectors(lba, buffer, 1);
+}
+
+bool FAT32::read_sectors(uint32_t lba, uint8_t* buffer, uint32_t count) {
     // Validate input
     if (buffer == nullptr) {
-        libc::printf("Error: Null buffer provided to read_sector\n");
+        libc::printf("Error: Null buffer provided to read_sectors\n");
         return false;
     }
     
     // Validate LBA
     if (lba < partition_lba) {
-        libc::printf("Error: Invalid LBA provided to read_sector: ");
+        libc::printf("Error: Invalid LBA provided to read_sectors: ");
         libc::print_hex(lba);
         libc::printf("\n");
         return false;
     }
     
-    // Read a single sector from disk
-    // Note: In a real implementation, we would check the return value of read28
-    // For now, we'll assume it succeeds as in the original code
-    disk->read28(lba, buffer, 512);
-    return true;
+    return disk->read_blocks(lba, buffer, count);
 }
 
 uint32_t FAT32::get_next_cluster(uint32_t cluster) {
@@ -153,17 +353,23 @@ uint32_t FAT32::get_next_cluster(uint32_t cluster) {
         return 0xFFFFFFFF; // Invalid sector
     }
     
-    // Read the FAT sector
-    uint8_t fat_buffer[512];
-    if (!read_sector(fat_start + fat_sector, fat_buffer)) {
-        libc::printf("Error: Failed to read FAT sector\n");
-        return 0xFFFFFFFF; // Error reading sector
+    uint32_t next_cluster;
+    if (fat_table != 0) {
+        // In-memory FAT: no disk access
+        next_cluster = fat_table[cluster] & 0x0FFFFFFF;
+    } else {
+        // Read the FAT sector
+        uint8_t fat_buffer[512];
+        if (!read_sector(fat_start + fat_sector, fat_buffer)) {
+            libc::printf("Error: Failed to read FAT sector\n");
+            return 0xFFFFFFFF; // Error reading sector
+        }
+        
+        // Extract the next cluster value
+        uint32_t* fat_entry = (uint32_t*)fat_buffer;
+        next_cluster = fat_entry[fat_offset] & 0x0FFFFFFF; // Mask to 28 bits
     }
     
-    // Extract the next cluster value
-    uint32_t* fat_entry = (uint32_t*)fat_buffer;
-    uint32_t next_cluster = fat_entry[fat_offset] & 0x0FFFFFFF; // Mask to 28 bits
-    
     // Check for end of chain markers
     if (next_cluster >= 0x0FFFFFF8) {
         return 0; // End of chain
@@ -190,14 +396,12 @@ bool FAT32::read_cluster(uint32_t cluster, uint8_t* buffer) {
     // Convert cluster to LBA
     uint32_t lba = cluster_to_lba(cluster);
     
-    // Read all sectors in this cluster
-    for (int i = 0; i < bpb.sector_per_cluster; i++) {
-        if (!read_sector(lba + i, buffer + (i * 512))) {
-            libc::printf("Error: Failed to read sector in cluster: ");
-            libc::print_hex(lba + i);
-            libc::printf("\n");
-            return false;
-        }
+    // Read the whole cluster with one command
+    if (!read_sectors(lba, buffer, bpb.sector_per_cluster)) {
+        libc::printf("Error: Failed to read cluster at LBA: ");
+        libc::print_hex(lba);
+        libc::printf("\n");
+        return false;
     }
     
     return true;
@@ -241,7 +445,7 @@ bool FAT32::find_file_in_root(const char* name, DirectoryEntryFat32* entry) {
     }
     
     // Buffer to hold directory cluster data
-    uint8_t* buffer = new uint8_t[512 * 32]; // Assuming max 32 sectors per cluster
+    uint8_t* buffer = alloc_cluster_buffer(); // Assuming max 32 sectors per cluster
     
     // Start with the root cluster
     uint32_t current_cluster = root_cluster;
@@ -298,7 +502,7 @@ bool FAT32::find_file_in_root(const char* name, DirectoryEntryFat32* entry) {
             // Compare with requested name (case insensitive comparison)
             if (strcasecmp(entry_name, name) == 0) {
                 *entry = dir_entry[i];
-                delete[] buffer;
+                free_cluster_buffer(buffer);
                 return true;
             }
         }
@@ -309,14 +513,14 @@ bool FAT32::find_file_in_root(const char* name, DirectoryEntryFat32* entry) {
         // Check for invalid cluster chain
         if (next_cluster == 0xFFFFFFFF) {
             libc::printf("Error: Invalid cluster chain in root directory\n");
-            delete[] buffer;
+            free_cluster_buffer(buffer);
             return false;
         }
         
         current_cluster = next_cluster;
     }
     
-    delete[] buffer;
+    free_cluster_buffer(buffer);
     return false;
 }
 
@@ -406,6 +610,13 @@ int FAT32::open(const char* path) {
     file_descriptors[fd].position = 0;
     file_descriptors[fd].is_open = true;
     
+    // The extent map is built on the first read
+    file_descriptors[fd].extents = nullptr;
+    file_descriptors[fd].extent_count = 0;
+    file_descriptors[fd].extent_capacity = 0;
+    file_descriptors[fd].mapped_clusters = 0;
+    file_descriptors[fd].extents_valid = false;
+    
     return fd;
 }
 
@@ -443,16 +654,47 @@ int FAT32::read(int fd, uint8_t* buf, uint32_t size) {
     // Read data
     uint32_t bytes_read = 0;
     uint8_t sector_buffer[512];
+    uint32_t cluster_bytes = bpb.sector_per_cluster * 512;
     
-    while (bytes_read < size && file->current_cluster != 0) {
+    while (bytes_read < size) {
+        // Find the cluster through the extent map instead of walking the chain
+        uint32_t cluster, run;
+        if (!map_cluster(file, file->position / cluster_bytes, &cluster, &run)) {
+            libc::printf("Error: File position beyond its cluster chain\n");
+            update_cursor(file);
+            return bytes_read > 0 ? bytes_read : -1;
+        }
+        
         // Calculate current LBA
-        uint32_t lba = cluster_to_lba(file->current_cluster) + file->current_sector_in_cluster;
+        uint32_t sector_in_cluster = (file->position % cluster_bytes) / 512;
+        uint32_t lba = cluster_to_lba(cluster) + sector_in_cluster;
         
-        // Read the sector
+        // Fast path: whole sectors at a sector boundary go straight into the
+        // caller's buffer, as one transfer over the contiguous clusters
+        uint32_t whole_sectors = (size - bytes_read) / 512;
+        if (file->position % 512 == 0 && whole_sectors > 0) {
+            uint32_t contiguous = run * bpb.sector_per_cluster - sector_in_cluster;
+            if (whole_sectors > contiguous) {
+                whole_sectors = contiguous;
+            }
+            if (!read_sectors(lba, buf + bytes_read, whole_sectors)) {
+                libc::printf("Error: Failed to read sectors at LBA ");
+                libc::print_hex(lba);
+                libc::printf("\n");
+                update_cursor(file);
+                return bytes_read > 0 ? bytes_read : -1;
+            }
+            bytes_read += whole_sectors * 512;
+            file->position += whole_sectors * 512;
+            continue;
+        }
+        
+        // Unaligned head or partial tail: read the sector into sector_buffer
         if (!read_sector(lba, sector_buffer)) {
             libc::printf("Error: Failed to read sector at LBA ");
             libc::print_hex(lba);
             libc::printf("\n");
+            update_cursor(file);
             return -1; // Error reading sector
         }
         
@@ -471,26 +713,98 @@ int FAT32::read(int fd, uint8_t* buf, uint32_t size) {
         // Update position
         bytes_read += bytes_from_sector;
         file->position += bytes_from_sector;
-        
-        // Update sector tracking
-        file->current_sector_in_cluster = (file->position / 512) % bpb.sector_per_cluster;
-        
-        // If we've reached the end of the current cluster, move to next cluster
-        if (file->current_sector_in_cluster == 0 && file->position > 0 && bytes_read < size) {
-            file->current_cluster = get_next_cluster(file->current_cluster);
-            file->current_sector_in_cluster = 0;
-            
-            // Check for invalid cluster chain
-            if (file->current_cluster == 0xFFFFFFFF) {
-                libc::printf("Error: Invalid cluster chain detected\n");
-                return -1;
-            }
-        }
     }
     
+    // Keep the write cursor in step with the new position
+    update_cursor(file);
     return bytes_read;
 }
 
+int FAT32::lseek(int fd, int32_t offset, int whence) {
+    // Validate file descriptor
+    if (fd < 0 || fd >= FAT32_MAX_OPEN_FILES || !file_descriptors[fd].is_open) {
+        libc::printf("Error: Invalid file descriptor\n");
+        return -1;
+    }
+    
+    FileDescriptor* file = &file_descriptors[fd];
+    
+    int64_t base;
+    if (whence == FAT32_SEEK_SET) {
+        base = 0;
+    } else if (whence == FAT32_SEEK_CUR) {
+        base = file->position;
+    } else if (whence == FAT32_SEEK_END) {
+        base = file->size;
+    } else {
+        libc::printf("Error: Invalid lseek origin\n");
+        return -1;
+    }
+    
+    int64_t position = base + offset;
+    if (position < 0 || position > (int64_t)file->size) {
+        libc::printf("Error: lseek outside the file\n");
+        return -1;
+    }
+    
+    // The extent map turns the new position into a cluster without a chain walk
+    if (!build_extent_map(file)) {
+        return -1;
+    }
+    file->position = (uint32_t)position;
+    update_cursor(file);
+    return (int)file->position;
+}
+
+int FAT32::pread(int fd, uint8_t* buf, uint32_t size, uint32_t offset) {
+    if (fd < 0 || fd >= FAT32_MAX_OPEN_FILES || !file_descriptors[fd].is_open) {
+        libc::printf("Error: Invalid file descriptor\n");
+        return -1;
+    }
+    
+    FileDescriptor* file = &file_descriptors[fd];
+    if (offset >= file->size) {
+        return 0; // EOF
+    }
+    
+    uint32_t saved_position = file->position;
+    if (!build_extent_map(file)) {
+        return -1;
+    }
+    file->position = offset;
+    update_cursor(file);
+    int result = read(fd, buf, size);
+    
+    file->position = saved_position;
+    update_cursor(file);
+    return result;
+}
+
+int FAT32::pwrite(int fd, uint8_t* buf, uint32_t size, uint32_t offset) {
+    if (fd < 0 || fd >= FAT32_MAX_OPEN_FILES || !file_descriptors[fd].is_open) {
+        libc::printf("Error: Invalid file descriptor\n");
+        return -1;
+    }
+    
+    FileDescriptor* file = &file_descriptors[fd];
+    if (offset > file->size) {
+        libc::printf("Error: pwrite offset past the end of the file\n");
+        return -1;
+    }
+    
+    uint32_t saved_position = file->position;
+    if (!build_extent_map(file)) {
+        return -1;
+    }
+    file->position = offset;
+    update_cursor(file);
+    int result = write(fd, buf, size);
+    
+    file->position = saved_position;
+    update_cursor(file);
+    return result;
+}
+
 void FAT32::close(int fd) {
     // Validate file descriptor
     if (fd < 0 || fd >= FAT32_MAX_OPEN_FILES) {
@@ -503,6 +817,8 @@ void FAT32::close(int fd) {
         return;
     }
     
+    free_extent_map(&file_descriptors[fd]);
+    
     // Reset file descriptor fields for safety
     file_descriptors[fd].first_cluster = 0;
     file_descriptors[fd].current_cluster = 0;
@@ -516,7 +832,7 @@ void FAT32::close(int fd) {
 
 void FAT32::list_root() {
     // Buffer to hold directory cluster data
-    uint8_t* buffer = new uint8_t[512 * 32]; // Assuming max 32 sectors per cluster
+    uint8_t* buffer = alloc_cluster_buffer(); // Assuming max 32 sectors per cluster
     
     // Start with the root cluster
     uint32_t current_cluster = root_cluster;
@@ -527,7 +843,7 @@ void FAT32::list_root() {
         // Read the current cluster
         if (!read_cluster(current_cluster, buffer)) {
             libc::printf("Error: Failed to read root directory cluster\n");
-            delete[] buffer;
+            free_cluster_buffer(buffer);
             return;
         }
         
@@ -628,7 +944,7 @@ void FAT32::list_root() {
     if (directory_empty) {
         libc::printf("Root directory is empty\n");
     }
-    delete[] buffer;
+    free_cluster_buffer(buffer);
 }
 
 // write(): Writes data to a file
@@ -656,21 +972,38 @@ int FAT32::write(int fd, uint8_t* buf, uint32_t size) {
     // Write data
     uint32_t bytes_written = 0;
     uint8_t sector_buffer[512];
+    uint32_t cluster_bytes = bpb.sector_per_cluster * 512;
+    uint32_t start_position = file->position;
+    uint32_t start_size = file->size;
+    bool failed = false;
+    
+    // Whole sectors go to the disk straight from 'buf' without waiting;
+    // the requests are collected here and waited for together
+    driver::BlockRequest requests[FAT32_WRITE_BATCH];
+    uint32_t request_offsets[FAT32_WRITE_BATCH]; // bytes_written when each was submitted
+    uint32_t batched = 0;
     
     while (bytes_written < size) {
-        // If file has no clusters yet, allocate one
+        // Clusters the rest of this write needs; new clusters are reserved
+        // for all of it at once, as one contiguous extent where possible
+        uint32_t clusters_wanted = (size - bytes_written + cluster_bytes - 1) / cluster_bytes;
+        
+        // If file has no clusters yet, allocate its first extent
         if (file->first_cluster == 0) {
-            uint32_t new_cluster;
-            if (!allocate_cluster(&new_cluster)) {
+            uint32_t new_cluster, extent_length;
+            if (!allocate_extent(0, clusters_wanted, &new_cluster, &extent_length)) {
                 libc::printf("Error: Failed to allocate cluster for file\n");
-                return bytes_written > 0 ? bytes_written : -1;
+                failed = true;
+                break;
             }
             
-            // Initialize the cluster with zeros
-            libc::memset(sector_buffer, 0, sizeof(sector_buffer));
-            for (int i = 0; i < bpb.sector_per_cluster; i++) {
-                write_sector(cluster_to_lba(new_cluster) + i, sector_buffer);
+            // Clusters the rest of this write fills completely are not zeroed;
+            // only the one that will hold the end of the data is
+            uint32_t covered = (size - bytes_written) / cluster_bytes;
+            if (covered < extent_length) {
+                zero_cluster(new_cluster + covered);
             }
+            append_extent(file, new_cluster, extent_length);
             
             // Set file's first cluster
             file->first_cluster = new_cluster;
@@ -694,22 +1027,23 @@ int FAT32::write(int fd, uint8_t* buf, uint32_t size) {
         if (file->current_sector_in_cluster >= bpb.sector_per_cluster) {
             uint32_t next_cluster = get_next_cluster(file->current_cluster);
             
-            // If there's no next cluster, allocate one
+            // If there's no next cluster, allocate an extent right after
+            // the current one if it is free; it is linked to the chain
             if (next_cluster == 0 || next_cluster == 0x0FFFFFFF) {
-                uint32_t new_cluster;
-                if (!allocate_cluster(&new_cluster)) {
+                uint32_t new_cluster, extent_length;
+                if (!allocate_extent(file->current_cluster, clusters_wanted, &new_cluster, &extent_length)) {
                     libc::printf("Error: Failed to allocate cluster for file\n");
-                    return bytes_written > 0 ? bytes_written : -1;
+                    failed = true;
+                    break;
                 }
                 
-                // Link the new cluster to the chain
-                set_next_cluster(file->current_cluster, new_cluster);
-                
-                // Initialize the new cluster with zeros
-                libc::memset(sector_buffer, 0, sizeof(sector_buffer));
-                for (int i = 0; i < bpb.sector_per_cluster; i++) {
-                    write_sector(cluster_to_lba(new_cluster) + i, sector_buffer);
+                // Clusters the rest of this write fills completely are not zeroed;
+                // only the one that will hold the end of the data is
+                uint32_t covered = (size - bytes_written) / cluster_bytes;
+                if (covered < extent_length) {
+                    zero_cluster(new_cluster + covered);
                 }
+                append_extent(file, new_cluster, extent_length);
                 
                 next_cluster = new_cluster;
             }
@@ -720,33 +1054,78 @@ int FAT32::write(int fd, uint8_t* buf, uint32_t size) {
         
         // Calculate current LBA
         uint32_t lba = cluster_to_lba(file->current_cluster) + file->current_sector_in_cluster;
-        
-        // Read the current sector to preserve existing data
-        if (!read_sector(lba, sector_buffer)) {
-            libc::printf("Error: Failed to read sector at LBA ");
-            libc::print_hex(lba);
-            libc::printf("\n");
-            return bytes_written > 0 ? bytes_written : -1;
-        }
-        
-        // Calculate how many bytes we can write to this sector
         uint32_t sector_offset = file->position % 512;
-        uint32_t bytes_to_sector = 512 - sector_offset;
         uint32_t bytes_remaining = size - bytes_written;
+        uint32_t bytes_to_sector;
         
-        if (bytes_to_sector > bytes_remaining) {
-            bytes_to_sector = bytes_remaining;
-        }
-        
-        // Copy data to sector buffer
-        libc::memcpy(sector_buffer + sector_offset, buf + bytes_written, bytes_to_sector);
-        
-        // Write the sector back
-        if (!write_sector(lba, sector_buffer)) {
-            libc::printf("Error: Failed to write sector at LBA ");
-            libc::print_hex(lba);
-            libc::printf("\n");
-            return bytes_written > 0 ? bytes_written : -1;
+        if (sector_offset == 0 && bytes_remaining >= 512) {
+            // Whole sectors: one request up to the end of the contiguous
+            // run of clusters, with nothing to read first
+            uint32_t sectors = bytes_remaining / 512;
+            uint32_t available = bpb.sector_per_cluster - file->current_sector_in_cluster;
+            uint32_t cluster, run;
+            if (map_cluster(file, file->position / cluster_bytes, &cluster, &run) &&
+                cluster == file->current_cluster) {
+                available = run * bpb.sector_per_cluster - file->current_sector_in_cluster;
+            }
+            if (sectors > available) {
+                sectors = available;
+            }
+            
+            if (batched == FAT32_WRITE_BATCH) {
+                uint32_t failed_request = wait_writes(requests, batched);
+                batched = 0;
+                if (failed_request < FAT32_WRITE_BATCH) {
+                    bytes_written = request_offsets[failed_request];
+                    failed = true;
+                    break;
+                }
+            }
+            request_offsets[batched] = bytes_written;
+            submit_write(&requests[batched++], lba, buf + bytes_written, sectors);
+            bytes_to_sector = sectors * 512;
+            
+            // Move to the last sector written; at a cluster boundary the
+            // index stays past the end, as below
+            uint32_t sector_index = file->current_sector_in_cluster + sectors;
+            uint32_t clusters_passed = (sector_index - 1) / bpb.sector_per_cluster;
+            file->current_cluster += clusters_passed;
+            file->current_sector_in_cluster = sector_index - clusters_passed * bpb.sector_per_cluster;
+        } else {
+            // Read the current sector to preserve existing data
+            if (!read_sector(lba, sector_buffer)) {
+                libc::printf("Error: Failed to read sector at LBA ");
+                libc::print_hex(lba);
+                libc::printf("\n");
+                failed = true;
+                break;
+            }
+            
+            // Calculate how many bytes we can write to this sector
+            bytes_to_sector = 512 - sector_offset;
+            if (bytes_to_sector > bytes_remaining) {
+                bytes_to_sector = bytes_remaining;
+            }
+            
+            // Copy data to sector buffer
+            libc::memcpy(sector_buffer + sector_offset, buf + bytes_written, bytes_to_sector);
+            
+            // Write the sector back
+            if (!write_sector(lba, sector_buffer)) {
+                libc::printf("Error: Failed to write sector at LBA ");
+                libc::print_hex(lba);
+                libc::printf("\n");
+                failed = true;
+                break;
+            }
+            
+            // Update sector tracking. At a cluster boundary, leave the index
+            // past the end so the next write moves on to the next cluster
+            uint32_t position = file->position + bytes_to_sector;
+            file->current_sector_in_cluster = (position / 512) % bpb.sector_per_cluster;
+            if (position % cluster_bytes == 0) {
+                file->current_sector_in_cluster = bpb.sector_per_cluster;
+            }
         }
         
         // Update position and counters
@@ -757,22 +1136,42 @@ int FAT32::write(int fd, uint8_t* buf, uint32_t size) {
         if (file->position > file->size) {
             file->size = file->position;
         }
-        
-        // Update directory entry
+    }
+    
+    // Wait for the whole-sector writes; nothing from the first one that
+    // failed on counts as written
+    if (batched > 0) {
+        uint32_t failed_request = wait_writes(requests, batched);
+        if (failed_request < batched) {
+            libc::printf("Error: Failed to write file data\n");
+            bytes_written = request_offsets[failed_request];
+            failed = true;
+        }
+    }
+    
+    if (failed) {
+        // Keep what was written and free the clusters reserved past it
+        file->position = start_position + bytes_written;
+        file->size = start_size > file->position ? start_size : file->position;
+        update_cursor(file);
+        trim_chain(file);
+    }
+    
+    // Record the new size in the directory entry once, after the data
+    if (file->size != start_size) {
         DirectoryEntryFat32 entry;
         uint32_t entry_cluster, entry_offset;
-        if (find_file_in_directory(file->parent_cluster, file_descriptors[fd].name, &entry, &entry_cluster, &entry_offset)) {
+        if (find_file_in_directory(file->parent_cluster, file->name, &entry, &entry_cluster, &entry_offset)) {
             entry.size = file->size;
-            uint8_t sector_buffer[512];
             read_sector(cluster_to_lba(entry_cluster) + (entry_offset / 512), sector_buffer);
             *((DirectoryEntryFat32*)(sector_buffer + (entry_offset % 512))) = entry;
             write_sector(cluster_to_lba(entry_cluster) + (entry_offset / 512), sector_buffer);
         }
-
-        // Update sector tracking
-        file->current_sector_in_cluster = (file->position / 512) % bpb.sector_per_cluster;
     }
     
+    if (failed && bytes_written == 0) {
+        return -1;
+    }
     return bytes_written;
 }
 
@@ -0,0 +1,140 @@
+#include "../include/filesystem/fat32.h"
+#include "../include/libc/string.h"
+
+namespace uqaabOS {
+namespace filesystem {
+
+/* Extent maps
+ * An open file's cluster chain is described as a sorted list of runs of
+ * contiguous clusters. It is built from the FAT the first time the file is
+ * read or positioned, then extended as write() allocates. A lookup is a
+ * binary search over the runs instead of a walk along the chain. */
+
+bool FAT32::append_extent(FileDescriptor *file, uint32_t start_cluster,
+                          uint32_t length) {
+  if (!file->extents_valid)
+    return true; // Built from the FAT when needed
+
+  // Continues the last run on disk: just lengthen it
+  if (file->extent_count > 0) {
+    FileExtent *last = &file->extents[file->extent_count - 1];
+    if (last->start_cluster + last->length == start_cluster) {
+      last->length += length;
+      file->mapped_clusters += length;
+      return true;
+    }
+  }
+
+  if (file->extent_count == file->extent_capacity) {
+    uint32_t capacity = file->extent_capacity != 0
+                            ? file->extent_capacity * 2
+                            : FAT32_INITIAL_FILE_EXTENTS;
+    FileExtent *extents = new FileExtent[capacity];
+    if (extents == nullptr) {
+      libc::printf("Error: Out of memory for the extent map\n");
+      free_extent_map(file);
+      return false;
+    }
+    if (file->extents != nullptr) {
+      libc::memcpy(extents, file->extents,
+                   file->extent_count * sizeof(FileExtent));
+      delete[] file->extents;
+    }
+    file->extents = extents;
+    file->extent_capacity = capacity;
+  }
+
+  FileExtent *extent = &file->extents[file->extent_count++];
+  extent->file_cluster = file->mapped_clusters;
+  extent->start_cluster = start_cluster;
+  extent->length = length;
+  file->mapped_clusters += length;
+  return true;
+}
+
+bool FAT32::build_extent_map(FileDescriptor *file) {
+  if (file->extents_valid)
+    return true;
+
+  file->extent_count = 0;
+  file->mapped_clusters = 0;
+  file->extents_valid = true;
+
+  // A chain longer than the volume has clusters must contain a loop
+  uint32_t limit = cluster_count;
+  uint32_t cluster = file->first_cluster;
+  while (cluster >= 2 && limit-- > 0) {
+    if (!append_extent(file, cluster, 1))
+      return false;
+    uint32_t next = get_next_cluster(cluster);
+    if (next == 0xFFFFFFFF) {
+      libc::printf("Error: Invalid cluster chain detected\n");
+      free_extent_map(file);
+      return false;
+    }
+    cluster = next;
+  }
+  return true;
+}
+
+void FAT32::free_extent_map(FileDescriptor *file) {
+  if (file->extents != nullptr)
+    delete[] file->extents;
+  file->extents = nullptr;
+  file->extent_count = 0;
+  file->extent_capacity = 0;
+  file->mapped_clusters = 0;
+  file->extents_valid = false;
+}
+
+bool FAT32::map_cluster(FileDescriptor *file, uint32_t index,
+                        uint32_t *cluster, uint32_t *run) {
+  if (!build_extent_map(file) || index >= file->mapped_clusters)
+    return false;
+
+  // Last extent whose first file cluster is <= index
+  uint32_t low = 0;
+  uint32_t high = file->extent_count - 1;
+  while (low < high) {
+    uint32_t middle = (low + high + 1) / 2;
+    if (file->extents[middle].file_cluster <= index)
+      low = middle;
+    else
+      high = middle - 1;
+  }
+
+  FileExtent *extent = &file->extents[low];
+  uint32_t offset = index - extent->file_cluster;
+  *cluster = extent->start_cluster + offset;
+  if (run != nullptr)
+    *run = extent->length - offset;
+  return true;
+}
+
+// Points current_cluster/current_sector_in_cluster at 'position'. At a
+// cluster boundary they stay on the previous cluster with the sector index
+// past its end, as write() leaves them.
+void FAT32::update_cursor(FileDescriptor *file) {
+  uint32_t cluster_bytes = bpb.sector_per_cluster * 512;
+  if (file->position == 0 || file->first_cluster == 0) {
+    file->current_cluster = file->first_cluster;
+    file->current_sector_in_cluster = 0;
+    return;
+  }
+
+  uint32_t index = file->position / cluster_bytes;
+  uint32_t sector = (file->position % cluster_bytes) / 512;
+  if (file->position % cluster_bytes == 0) {
+    index--;
+    sector = bpb.sector_per_cluster;
+  }
+
+  uint32_t cluster;
+  if (map_cluster(file, index, &cluster, nullptr)) {
+    file->current_cluster = cluster;
+    file->current_sector_in_cluster = sector;
+  }
+}
+
+} // namespace filesystem
+} // namespace uqaabOS
@@ -39,6 +39,44 @@ void FAT32::ls(const char *path) {
   list_directory(dir_cluster);
 }
 
+uint32_t FAT32::get_total_clusters() {
+  return cluster_count >= 2 ? cluster_count - 2 : 0;
+}
+
+// FAT32_FSINFO_UNKNOWN if neither the bitmap nor FSInfo provided a count
+uint32_t FAT32::get_free_clusters() { return free_clusters; }
+
+uint32_t FAT32::get_cluster_size() { return bpb.sector_per_cluster * 512; }
+
+void FAT32::df() {
+  // Sizes in KiB: a cluster is sector_per_cluster / 2 KiB
+  uint32_t total = get_total_clusters();
+  uint32_t total_kib = (uint32_t)(((uint64_t)total * bpb.sector_per_cluster) >> 1);
+
+  libc::printf("Cluster size: %d bytes\n", (int)get_cluster_size());
+  libc::printf("Total:        %d KiB (%d clusters)\n", (int)total_kib, (int)total);
+
+  if (free_clusters == FAT32_FSINFO_UNKNOWN) {
+    libc::printf("Free:         unknown\n");
+    return;
+  }
+  uint32_t free_kib =
+      (uint32_t)(((uint64_t)free_clusters * bpb.sector_per_cluster) >> 1);
+  uint32_t used = total - free_clusters;
+  libc::printf("Used:         %d KiB (%d clusters)\n", (int)(total_kib - free_kib),
+               (int)used);
+  libc::printf("Free:         %d KiB (%d clusters)\n", (int)free_kib,
+               (int)free_clusters);
+  if (total != 0) {
+    // Scale down so used * 100 fits in 32 bits
+    while (total > 0x00FFFFFF) {
+      total >>= 1;
+      used >>= 1;
+    }
+    libc::printf("Use:          %d%%\n", (int)(used * 100 / total));
+  }
+}
+
 bool FAT32::mkdir(const char *path) {
   // Parse the path to separate parent directory and new directory name
   char parent_path[256];
@@ -73,8 +111,8 @@ bool FAT32::mkdir(const char *path) {
   }
 
   // Create the directory entries for "." and ".."
-  uint8_t* dir_buffer = new uint8_t[512 * 32]; // Buffer for the new directory cluster
-  libc::memset(dir_buffer, 0, 512 * 32);
+  uint8_t* dir_buffer = alloc_cluster_buffer(); // Buffer for the new directory cluster
+  libc::memset(dir_buffer, 0, FAT32_CLUSTER_BUFFER_SIZE);
 
   DirectoryEntryFat32 *dir_entries = (DirectoryEntryFat32 *)dir_buffer;
 
@@ -103,10 +141,10 @@ bool FAT32::mkdir(const char *path) {
 
   // Write the new directory cluster
   write_cluster(new_cluster, dir_buffer);
-  delete[] dir_buffer;
+  free_cluster_buffer(dir_buffer);
 
   // Find a free entry in the parent directory
-  uint8_t* parent_buffer = new uint8_t[512 * 32];
+  uint8_t* parent_buffer = alloc_cluster_buffer();
   uint32_t current_cluster = parent_cluster;
   bool entry_found = false;
   uint32_t free_entry_cluster = 0;
@@ -138,16 +176,16 @@ bool FAT32::mkdir(const char *path) {
         if (!allocate_cluster(&next_cluster)) {
           libc::printf("Failed to allocate cluster for parent directory  \n");
           free_cluster_chain(new_cluster); // Clean up
-          delete[] parent_buffer;
+          free_cluster_buffer(parent_buffer);
           return false;
         }
         // Link the new cluster to the chain
         set_next_cluster(current_cluster, next_cluster);
         // Initialize new cluster with zeros
-        uint8_t* zero_buffer = new uint8_t[512 * 32];
-        libc::memset(zero_buffer, 0, 512 * 32);
+        uint8_t* zero_buffer = alloc_cluster_buffer();
+        libc::memset(zero_buffer, 0, FAT32_CLUSTER_BUFFER_SIZE);
         write_cluster(next_cluster, zero_buffer);
-        delete[] zero_buffer;
+        free_cluster_buffer(zero_buffer);
         // Set the new cluster as the current cluster
         current_cluster = next_cluster;
         // Retry with the new cluster
@@ -164,7 +202,7 @@ bool FAT32::mkdir(const char *path) {
   if (!entry_found) {
     libc::printf("Failed to find free entry in parent directory  \n");
     free_cluster_chain(new_cluster); // Clean up
-    delete[] parent_buffer;
+    free_cluster_buffer(parent_buffer);
     return false;
   }
 
@@ -217,7 +255,7 @@ bool FAT32::mkdir(const char *path) {
   write_sector(cluster_to_lba(free_entry_cluster) + (free_entry_offset / 512),
                parent_buffer);
 
-  delete[] parent_buffer;
+  free_cluster_buffer(parent_buffer);
 
   libc::printf("Directory created: ");
   libc::printf(path);
@@ -257,7 +295,7 @@ bool FAT32::touch(const char *path) {
   }
 
   // Find a free entry in the parent directory
-  uint8_t* parent_buffer = new uint8_t[512];
+  uint8_t* parent_buffer = alloc_cluster_buffer();
   uint32_t current_cluster = parent_cluster;
   bool entry_found = false;
   uint32_t free_entry_cluster = 0;
@@ -288,16 +326,16 @@ bool FAT32::touch(const char *path) {
         // Need to allocate a new cluster for the parent directory
         if (!allocate_cluster(&next_cluster)) {
           libc::printf("Failed to allocate cluster for parent directory  \n");
-          delete[] parent_buffer;
+          free_cluster_buffer(parent_buffer);
           return false;
         }
         // Link the new cluster to the chain
         set_next_cluster(current_cluster, next_cluster);
         // Initialize new cluster with zeros
-        uint8_t* zero_buffer = new uint8_t[512 * 32];
-        libc::memset(zero_buffer, 0, 512 * 32);
+        uint8_t* zero_buffer = alloc_cluster_buffer();
+        libc::memset(zero_buffer, 0, FAT32_CLUSTER_BUFFER_SIZE);
         write_cluster(next_cluster, zero_buffer);
-        delete[] zero_buffer;
+        free_cluster_buffer(zero_buffer);
         // Set the new cluster as the current cluster
         current_cluster = next_cluster;
         // Retry with the new cluster
@@ -313,7 +351,7 @@ bool FAT32::touch(const char *path) {
 
   if (!entry_found) {
     libc::printf("Failed to find free entry in parent directory  \n");
-    delete[] parent_buffer;
+    free_cluster_buffer(parent_buffer);
     return false;
   }
 
@@ -366,7 +404,7 @@ bool FAT32::touch(const char *path) {
   write_sector(cluster_to_lba(free_entry_cluster) + (free_entry_offset / 512),
                parent_buffer);
 
-  delete[] parent_buffer;
+  free_cluster_buffer(parent_buffer);
 
   libc::printf("File created: ");
   libc::printf(path);
@@ -475,7 +513,7 @@ bool FAT32::rmdir(const char *path) {
 
   // Check if directory is empty (only "." and ".." entries)
   bool is_empty = true;
-  uint8_t* dir_buffer = new uint8_t[512 * 32];
+  uint8_t* dir_buffer = alloc_cluster_buffer();
   uint32_t current_cluster = first_cluster;
 
   while (current_cluster != 0 && is_empty) {
@@ -611,7 +649,7 @@ bool FAT32::rmdir(const char *path) {
   // Write the sector back
   write_sector(sector_lba, sector_buffer);
 
-  delete[] dir_buffer;
+  free_cluster_buffer(dir_buffer);
 
   libc::printf("Directory deleted: ");
   libc::printf(path);
@@ -259,7 +259,7 @@ void FAT32::list_directory(uint32_t dir_cluster) {
   }
 
   // Buffer to hold directory cluster data
-  uint8_t* buffer = new uint8_t[512 * 32]; // Assuming max 32 sectors per cluster
+  uint8_t* buffer = alloc_cluster_buffer(); // Assuming max 32 sectors per cluster
 
 
   // Start with the given cluster
@@ -371,7 +371,7 @@ void FAT32::list_directory(uint32_t dir_cluster) {
   if (directory_empty) {
     libc::printf("Directory is empty \n");
   }
-  delete[] buffer;
+  free_cluster_buffer(buffer);
 }
 
 } // namespace filesystem
@@ -1,30 +1,63 @@
 #include "../include/filesystem/fat32.h"
+#include "../include/libc/string.h"
 
 namespace uqaabOS {
 namespace filesystem {
 
 bool FAT32::write_sector(uint32_t lba, uint8_t *buffer) {
+  return write_sectors(lba, buffer, 1);
+}
+
+bool FAT32::write_sectors(uint32_t lba, uint8_t *buffer, uint32_t count) {
   // Validate input
   if (buffer == nullptr) {
-    libc::printf("Error: Null buffer provided to write_sector\n");
+    libc::printf("Error: Null buffer provided to write_sectors\n");
     return false;
   }
   
   // Validate LBA
   if (lba < partition_lba) {
-    libc::printf("Error: Invalid LBA provided to write_sector: ");
+    libc::printf("Error: Invalid LBA provided to write_sectors: ");
     libc::print_hex(lba);
     libc::printf("\n");
     return false;
   }
   
-  // Write a single sector to disk
-  // Note: Since write28 is void, we can't check its return value
-  // but we can add validation before calling it
-  disk->write28(lba, buffer, 512);
-  
-  // Since we can't check the return value of write28, we'll assume it succeeds
-  // In a real implementation, we would implement a way to verify the write
+  return disk->write_blocks(lba, buffer, count);
+}
+
+void FAT32::submit_write(driver::BlockRequest *request, uint32_t lba,
+                         uint8_t *buffer, uint32_t count) {
+  *request = driver::BlockRequest(lba, buffer, count, true);
+  if (lba < partition_lba) {
+    libc::printf("Error: Invalid LBA provided to submit_write: ");
+    libc::print_hex(lba);
+    libc::printf("\n");
+    request->done = true; // Failed
+    return;
+  }
+  disk->submit(request);
+}
+
+uint32_t FAT32::wait_writes(driver::BlockRequest *requests, uint32_t count) {
+  // Every request is waited for, since the caller reuses them
+  uint32_t failed = count;
+  for (uint32_t i = 0; i < count; i++) {
+    if (!disk->wait(&requests[i]) && failed == count)
+      failed = i;
+  }
+  return failed;
+}
+
+bool FAT32::sync() {
+  // FSInfo first, so it goes out with the FAT and directory sectors
+  bool fsinfo_written = write_fsinfo();
+
+  // Writes back cached FAT and directory sectors, then the drive's cache
+  if (!disk->flush() || !fsinfo_written) {
+    libc::printf("Error: Failed to sync the filesystem\n");
+    return false;
+  }
   return true;
 }
 
@@ -52,19 +85,30 @@ bool FAT32::write_cluster(uint32_t cluster, uint8_t *buffer) {
     return false;
   }
 
-  // Write all sectors in this cluster
-  for (int i = 0; i < bpb.sector_per_cluster; i++) {
-    if (!write_sector(lba + i, buffer + (i * 512))) {
-      libc::printf("Error: Failed to write sector in cluster: ");
-      libc::print_hex(lba + i);
-      libc::printf("\n");
-      return false;
-    }
+  // Write the whole cluster with one command
+  if (!write_sectors(lba, buffer, bpb.sector_per_cluster)) {
+    libc::printf("Error: Failed to write cluster at LBA: ");
+    libc::print_hex(lba);
+    libc::printf("\n");
+    return false;
   }
 
   return true;
 }
 
+bool FAT32::zero_cluster(uint32_t cluster) {
+  // One write of a zeroed cluster instead of one per sector
+  uint8_t *zero_buffer = alloc_cluster_buffer();
+  if (zero_buffer == nullptr) {
+    libc::printf("Error: Out of memory in zero_cluster\n");
+    return false;
+  }
+  libc::memset(zero_buffer, 0, bpb.sector_per_cluster * 512);
+  bool result = write_cluster(cluster, zero_buffer);
+  free_cluster_buffer(zero_buffer);
+  return result;
+}
+
 bool FAT32::set_next_cluster(uint32_t cluster, uint32_t next_cluster) {
   // Validate cluster number
   if (cluster < 2) {
@@ -86,6 +130,21 @@ bool FAT32::set_next_cluster(uint32_t cluster, uint32_t next_cluster) {
     return false;
   }
 
+  // With the FAT in memory, update the entry there and write its sector
+  // from the table; no read is needed
+  if (fat_table != 0) {
+    cluster_state_changed(cluster, (fat_table[cluster] & 0x0FFFFFFF) == 0,
+                          (next_cluster & 0x0FFFFFFF) == 0);
+    fat_table[cluster] =
+        (fat_table[cluster] & 0xF0000000) | (next_cluster & 0x0FFFFFFF);
+    if (!write_sector(fat_start + fat_sector,
+                      (uint8_t *)&fat_table[fat_sector * 128])) {
+      libc::printf("Error: Failed to write FAT sector in set_next_cluster\n");
+      return false;
+    }
+    return true;
+  }
+
   // Read the FAT sector
   uint8_t fat_buffer[512];
   if (!read_sector(fat_start + fat_sector, fat_buffer)) {
@@ -95,6 +154,8 @@ bool FAT32::set_next_cluster(uint32_t cluster, uint32_t next_cluster) {
 
   // Update the next cluster value
   uint32_t *fat_entry = (uint32_t *)fat_buffer;
+  cluster_state_changed(cluster, (fat_entry[fat_offset] & 0x0FFFFFFF) == 0,
+                        (next_cluster & 0x0FFFFFFF) == 0);
   fat_entry[fat_offset] =
       (fat_entry[fat_offset] & 0xF0000000) | (next_cluster & 0x0FFFFFFF);
 
@@ -107,7 +168,58 @@ bool FAT32::set_next_cluster(uint32_t cluster, uint32_t next_cluster) {
   return true;
 }
 
+// Keeps the free bitmap and the FSInfo fields in step with a FAT entry
+// that set_next_cluster is about to change.
+void FAT32::cluster_state_changed(uint32_t cluster, bool was_free,
+                                  bool now_free) {
+  if (was_free == now_free || cluster >= cluster_count)
+    return;
+
+  if (free_bitmap != 0) {
+    if (now_free)
+      free_bitmap[cluster / 32] |= 1u << (cluster % 32);
+    else
+      free_bitmap[cluster / 32] &= ~(1u << (cluster % 32));
+  }
+  if (free_clusters != FAT32_FSINFO_UNKNOWN)
+    free_clusters += now_free ? 1 : -1;
+  if (!now_free)
+    next_free_hint = cluster + 1 < cluster_count ? cluster + 1 : 2;
+  fsinfo_dirty = true;
+}
+
 uint32_t FAT32::find_free_cluster() {
+  // With the bitmap, search 32 clusters per step from the FSInfo hint and
+  // wrap around once
+  if (free_bitmap != 0) {
+    if (free_clusters == 0)
+      return 0;
+    uint32_t words = (cluster_count + 31) / 32;
+    uint32_t start = next_free_hint / 32;
+    for (uint32_t i = 0; i <= words; i++) {
+      uint32_t word = (start + i) % words;
+      uint32_t bits = free_bitmap[word];
+      if (i == 0) // Skip clusters before the hint in its own word
+        bits &= ~0u << (next_free_hint % 32);
+      if (bits == 0)
+        continue;
+      uint32_t cluster = word * 32 + __builtin_ctz(bits);
+      if (cluster >= 2 && cluster < cluster_count)
+        return cluster;
+    }
+    return 0;
+  }
+
+  // Search the in-memory FAT without touching the disk
+  if (fat_table != 0) {
+    for (uint32_t cluster_num = 2; cluster_num < cluster_count; cluster_num++) {
+      if ((fat_table[cluster_num] & 0x0FFFFFFF) == 0x00000000) {
+        return cluster_num;
+      }
+    }
+    return 0;
+  }
+
   // Search the FAT for a free cluster (marked with 0x00000000)
   uint8_t fat_buffer[512];
 
@@ -161,10 +273,174 @@ bool FAT32::allocate_cluster(uint32_t *cluster) {
     return false;
   }
 
+  write_fsinfo();
+  return true;
+}
+
+/* Extent search
+ * Walks the free bitmap run by run, skipping whole words that are all
+ * used or all free. A run starting at 'goal' (just after a file's last
+ * cluster) is taken as is, so appends stay contiguous. Otherwise the
+ * smallest run that holds 'wanted' clusters wins, or the largest run if
+ * none does. */
+bool FAT32::find_free_extent(uint32_t wanted, uint32_t goal, uint32_t *start,
+                             uint32_t *length) {
+  if (free_bitmap == 0) {
+    *start = find_free_cluster();
+    *length = 1;
+    return *start != 0;
+  }
+  if (wanted == 0 || free_clusters == 0)
+    return false;
+
+  uint32_t best_start = 0;
+  uint32_t best_length = 0;
+  uint32_t cluster = 2;
+  if (goal >= 2 && goal < cluster_count &&
+      (free_bitmap[goal / 32] & (1u << (goal % 32))))
+    cluster = goal;
+
+  while (cluster < cluster_count) {
+    uint32_t bits = free_bitmap[cluster / 32] >> (cluster % 32);
+    if (bits == 0) {
+      cluster = (cluster / 32 + 1) * 32; // Rest of the word is in use
+      continue;
+    }
+    cluster += __builtin_ctz(bits);
+    if (cluster >= cluster_count)
+      break;
+
+    uint32_t run_start = cluster;
+    while (cluster < cluster_count) {
+      if (cluster % 32 == 0 && cluster + 32 <= cluster_count &&
+          free_bitmap[cluster / 32] == 0xFFFFFFFF) {
+        cluster += 32;
+        continue;
+      }
+      if (!(free_bitmap[cluster / 32] & (1u << (cluster % 32))))
+        break;
+      cluster++;
+    }
+    uint32_t run = cluster - run_start;
+
+    if (run_start == goal) {
+      best_start = run_start;
+      best_length = run;
+      break;
+    }
+    bool fits = run >= wanted;
+    bool best_fits = best_length >= wanted;
+    if ((fits && (!best_fits || run < best_length)) ||
+        (!fits && !best_fits && run > best_length)) {
+      best_start = run_start;
+      best_length = run;
+    }
+    if (best_length == wanted)
+      break; // Exact fit
+  }
+
+  if (best_length == 0)
+    return false;
+  *start = best_start;
+  *length = best_length < wanted ? best_length : wanted;
+  return true;
+}
+
+// Writes the FAT sectors covering a range of entries from fat_table with a
+// single request.
+bool FAT32::write_fat_range(uint32_t first_cluster, uint32_t last_cluster) {
+  uint32_t first_sector = first_cluster / (512 / sizeof(uint32_t));
+  uint32_t last_sector = last_cluster / (512 / sizeof(uint32_t));
+  if (!write_sectors(fat_start + first_sector,
+                     (uint8_t *)&fat_table[first_sector * 128],
+                     last_sector - first_sector + 1)) {
+    libc::printf("Error: Failed to write FAT sectors\n");
+    return false;
+  }
+  return true;
+}
+
+bool FAT32::allocate_extent(uint32_t previous, uint32_t wanted,
+                            uint32_t *start, uint32_t *length) {
+  if (start == nullptr || length == nullptr) {
+    libc::printf("Error: Null pointer provided to allocate_extent\n");
+    return false;
+  }
+
+  // A new file gets a pure best fit; a growing one tries to continue in place
+  uint32_t goal = previous != 0 ? previous + 1 : 0;
+  if (!find_free_extent(wanted, goal, start, length)) {
+    libc::printf("Error: No free clusters available\n");
+    return false;
+  }
+  uint32_t last = *start + *length - 1;
+
+  if (fat_table != 0) {
+    // Chain the run in memory, then write its FAT sectors in one go
+    for (uint32_t cluster = *start; cluster <= last; cluster++) {
+      cluster_state_changed(cluster, true, false);
+      uint32_t next = cluster < last ? cluster + 1 : 0x0FFFFFFF;
+      fat_table[cluster] = (fat_table[cluster] & 0xF0000000) | next;
+    }
+    if (!write_fat_range(*start, last)) {
+      // The run was free before: give it back in memory and in the bitmap
+      for (uint32_t cluster = *start; cluster <= last; cluster++) {
+        fat_table[cluster] &= 0xF0000000;
+        cluster_state_changed(cluster, false, true);
+      }
+      return false;
+    }
+  } else {
+    // End of chain first, so a failure leaves no dangling link
+    for (uint32_t cluster = last + 1; cluster > *start; cluster--) {
+      uint32_t next = cluster - 1 < last ? cluster : 0x0FFFFFFF;
+      if (!set_next_cluster(cluster - 1, next)) {
+        libc::printf("Error: Failed to chain allocated clusters\n");
+        if (cluster <= last)
+          free_cluster_chain(cluster); // The part already chained
+        return false;
+      }
+    }
+  }
+
+  if (previous != 0 && !set_next_cluster(previous, *start)) {
+    libc::printf("Error: Failed to link allocated clusters\n");
+    free_cluster_chain(*start);
+    return false;
+  }
+  write_fsinfo();
   return true;
 }
 
+// Submits FAT sectors first_sector..last_sector from fat_table as one more
+// request of a batch, waiting for the batch first if it is full. Returns
+// false if a write of that batch failed.
+bool FAT32::submit_fat_range(driver::BlockRequest *requests, uint32_t *batched,
+                             uint32_t first_sector, uint32_t last_sector) {
+  bool success = true;
+  if (*batched == FAT32_WRITE_BATCH) {
+    success = wait_writes(requests, *batched) == *batched;
+    *batched = 0;
+  }
+  submit_write(&requests[(*batched)++], fat_start + first_sector,
+               (uint8_t *)&fat_table[first_sector * 128],
+               last_sector - first_sector + 1);
+  return success;
+}
+
+/* Freeing a chain
+ * With the FAT in memory, the whole chain is freed there first. Each run
+ * of neighbouring FAT sectors it touched is written with one request, and
+ * the requests are waited for in batches of FAT32_WRITE_BATCH, so the
+ * block queue can sort and merge them. Without the table, the entries are
+ * cleared one by one. */
 bool FAT32::free_cluster_chain(uint32_t start_cluster) {
+  driver::BlockRequest requests[FAT32_WRITE_BATCH];
+  uint32_t batched = 0;
+  uint32_t first_sector = 0;
+  uint32_t last_sector = 0;
+  bool in_run = false;
+  bool success = true;
   uint32_t current_cluster = start_cluster;
 
   while (current_cluster != 0 && current_cluster != 0x0FFFFFFF) {
@@ -173,7 +449,8 @@ bool FAT32::free_cluster_chain(uint32_t start_cluster) {
       libc::printf("Error: Invalid cluster number in free_cluster_chain: ");
       libc::print_hex(current_cluster);
       libc::printf("\n");
-      return false;
+      success = false;
+      break;
     }
     
     // Get the next cluster before we overwrite the current one
@@ -182,20 +459,78 @@ bool FAT32::free_cluster_chain(uint32_t start_cluster) {
     // Check for invalid cluster chain
     if (next_cluster == 0xFFFFFFFF) {
       libc::printf("Error: Invalid cluster chain detected in free_cluster_chain\n");
-      return false;
+      success = false;
+      break;
     }
 
-    // Mark current cluster as free
-    if (!set_next_cluster(current_cluster, 0x00000000)) {
-      libc::printf("Error: Failed to mark cluster as free\n");
-      return false;
+    if (fat_table == 0) {
+      // Mark current cluster as free
+      if (!set_next_cluster(current_cluster, 0x00000000)) {
+        libc::printf("Error: Failed to mark cluster as free\n");
+        return false;
+      }
+      current_cluster = next_cluster;
+      continue;
+    }
+
+    cluster_state_changed(current_cluster,
+                          (fat_table[current_cluster] & 0x0FFFFFFF) == 0, true);
+    fat_table[current_cluster] &= 0xF0000000;
+
+    // Extend the run of FAT sectors, or submit it and start another
+    uint32_t sector = current_cluster / (512 / sizeof(uint32_t));
+    if (in_run && (sector < first_sector || sector > last_sector + 1)) {
+      if (!submit_fat_range(requests, &batched, first_sector, last_sector))
+        success = false;
+      in_run = false;
+    }
+    if (!in_run) {
+      first_sector = sector;
+      last_sector = sector;
+      in_run = true;
+    } else if (sector > last_sector) {
+      last_sector = sector;
     }
 
     // Move to next cluster
     current_cluster = next_cluster;
   }
 
-  return true;
+  if (in_run && !submit_fat_range(requests, &batched, first_sector, last_sector))
+    success = false;
+  if (batched > 0 && wait_writes(requests, batched) < batched)
+    success = false;
+  if (!success)
+    libc::printf("Error: Failed to free the cluster chain\n");
+  write_fsinfo();
+  return success;
+}
+
+// Frees the clusters past the end of a file that write() reserved but did
+// not fill, and points the cursor back inside what is left. A file keeps
+// at least its first cluster.
+void FAT32::trim_chain(FileDescriptor *file) {
+  if (file->first_cluster == 0)
+    return;
+
+  uint32_t cluster_bytes = bpb.sector_per_cluster * 512;
+  uint32_t needed = (file->size + cluster_bytes - 1) / cluster_bytes;
+  if (needed == 0)
+    needed = 1;
+
+  uint32_t last;
+  if (!map_cluster(file, needed - 1, &last, nullptr))
+    return;
+  uint32_t next = get_next_cluster(last);
+  if (next < 2 || next == 0xFFFFFFFF)
+    return; // Nothing reserved
+
+  if (!set_next_cluster(last, 0x0FFFFFFF) || !free_cluster_chain(next))
+    libc::printf("Error: Failed to free the unused end of the file\n");
+
+  // Rebuilt from the FAT when next needed
+  free_extent_map(file);
+  update_cursor(file);
 }
 
 } // namespace filesystem
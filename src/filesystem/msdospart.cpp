@@ -2,7 +2,7 @@
 
 /*
 This code implements, The function which reads
-the Master Boot Record (MBR) from an ATA hard drive and prints its contents in
+the Master Boot Record (MBR) from a block device and prints its contents in
 both raw and formatted forms. It also checks the validity of the MBR by
 verifying its magic number and prints information about the primary partitions.
 
@@ -16,13 +16,16 @@ The code includes:
 namespace uqaabOS {
 namespace filesystem {
 
-void MSDOSPartitionTable::read_partitions(driver::ATA *hd) {
+void MSDOSPartitionTable::read_partitions(driver::BlockDevice *hd) {
   MasterBootRecord mbr;
 
   libc::printf("MBR: ");
 
-  // Read the MBR from the hard drive into the mbr variable
-  hd->read28(0, (uint8_t *)&mbr, sizeof(MasterBootRecord));
+  // Read the MBR (exactly one sector) into the mbr variable
+  if (!hd->read_blocks(0, (uint8_t *)&mbr, 1)) {
+    libc::printf("read error");
+    return;
+  }
 
   // // RAW printing of MBR
   // for (int i = 0x1BE; i <= 0x01FF; i++) {
@@ -56,11 +59,13 @@ void MSDOSPartitionTable::read_partitions(driver::ATA *hd) {
   }
 }
 
-uint32_t MSDOSPartitionTable::get_first_fat32_partition_lba(driver::ATA *hd) {
+uint32_t MSDOSPartitionTable::get_first_fat32_partition_lba(driver::BlockDevice *hd) {
   MasterBootRecord mbr;
 
-  // Read the MBR from the hard drive into the mbr variable
-  hd->read28(0, (uint8_t *)&mbr, sizeof(MasterBootRecord));
+  // Read the MBR (exactly one sector) into the mbr variable
+  if (!hd->read_blocks(0, (uint8_t *)&mbr, 1)) {
+    return 0;
+  }
 
   // Check if the MBR's magic number is valid
   if (mbr.magicnumber != 0xAA55) {
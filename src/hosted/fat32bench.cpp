@@ -0,0 +1,295 @@
+#include "../include/drivers/storage/filedisk.h"
+#include "../include/drivers/storage/ramdisk.h"
+#include "../include/filesystem/fat32.h"
+#include "../include/memorymanagement/memorymanagement.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Description: Hosted FAT32 benchmark and stress test ('make hosted').
+ * Mounts a FAT32 disk image through FileBlockDevice, or through a RAMDisk
+ * loaded from it, and times rounds of file writes, verified reads and
+ * removals. The kernel heap, slab caches and filesystem code are the same
+ * sources the kernel is built from.
+ *
+ *   fat32bench [-f size_mib] [-r] [-n files] [-s size_kib] image
+ *
+ *   -f  create the image and format it as FAT32 first
+ *   -r  run on a RAMDisk copy of the image, written back at the end
+ *   -n  files per round (default 16)
+ *   -s  size of each file in KiB (default 256)
+ */
+
+using namespace uqaabOS;
+
+// Kernel heap for the filesystem, on top of any RAMDisk copy.
+#define BENCH_HEAP_BYTES (32 * 1024 * 1024)
+
+// Blocks copied per request when loading or saving a RAMDisk.
+#define BENCH_COPY_BLOCKS 2048
+
+static double now() {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static void put32(uint8_t *at, uint32_t value) { memcpy(at, &value, 4); }
+
+/* Formatting
+ * Writes an empty FAT32 volume the size of the image: 32 reserved sectors
+ * with the FSInfo sector at 1 and a backup boot sector at 6, two FATs and
+ * the root directory in cluster 2. */
+static bool format_image(const char *path, uint32_t size_mib) {
+  uint32_t total = size_mib * 2048;
+  uint32_t reserved = 32;
+  uint8_t per_cluster = total < 532480 ? 1 : 8;
+  uint32_t fat_size = ((total - reserved) / per_cluster + 2 + 127) / 128;
+  uint32_t clusters = (total - reserved - 2 * fat_size) / per_cluster;
+
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || ftruncate(fd, (off_t)total * 512) != 0) {
+    perror(path);
+    return false;
+  }
+
+  filesystem::BiosParameterBlock32 bpb;
+  memset(&bpb, 0, sizeof(bpb));
+  bpb.jump[0] = 0xEB;
+  bpb.jump[1] = 0x58;
+  bpb.jump[2] = 0x90;
+  memcpy(bpb.soft_name, "UQAABOS ", 8);
+  bpb.bytes_per_sector = 512;
+  bpb.sector_per_cluster = per_cluster;
+  bpb.reserved_sectors = reserved;
+  bpb.fat_copies = 2;
+  bpb.media_type = 0xF8;
+  bpb.sector_per_track = 32;
+  bpb.head_count = 64;
+  bpb.total_sector_count = total;
+  bpb.table_size = fat_size;
+  bpb.root_cluster = 2;
+  bpb.fat_info = 1;
+  bpb.backup_sector = 6;
+  bpb.drive_number = 0x80;
+  bpb.boot_signature = 0x29;
+  bpb.volume_id = 0x55514142;
+  memcpy(bpb.volume_label, "NO NAME    ", 11);
+  memcpy(bpb.fatType_label, "FAT32   ", 8);
+
+  uint8_t boot[512];
+  memset(boot, 0, sizeof(boot));
+  memcpy(boot, &bpb, sizeof(bpb));
+  boot[510] = 0x55;
+  boot[511] = 0xAA;
+
+  uint8_t fsinfo[512];
+  memset(fsinfo, 0, sizeof(fsinfo));
+  put32(fsinfo, FAT32_FSINFO_LEAD_SIGNATURE);
+  put32(fsinfo + 484, FAT32_FSINFO_STRUCT_SIGNATURE);
+  put32(fsinfo + 488, clusters - 1); // All but the root directory
+  put32(fsinfo + 492, 3);
+  put32(fsinfo + 508, FAT32_FSINFO_TRAIL_SIGNATURE);
+
+  uint8_t fat[512];
+  memset(fat, 0, sizeof(fat));
+  put32(fat, 0x0FFFFFF8);
+  put32(fat + 4, 0x0FFFFFFF);
+  put32(fat + 8, 0x0FFFFFFF); // Root directory
+
+  bool ok = pwrite(fd, boot, 512, 0) == 512 &&
+            pwrite(fd, fsinfo, 512, 512) == 512 &&
+            pwrite(fd, boot, 512, 6 * 512) == 512 &&
+            pwrite(fd, fsinfo, 512, 7 * 512) == 512 &&
+            pwrite(fd, fat, 512, (off_t)reserved * 512) == 512 &&
+            pwrite(fd, fat, 512, (off_t)(reserved + fat_size) * 512) == 512;
+  close(fd);
+  if (!ok) {
+    perror(path);
+    return false;
+  }
+  printf("Formatted %s: %u MiB, %u clusters of %u bytes\n", path, size_mib,
+         clusters, per_cluster * 512);
+  return true;
+}
+
+// Copies 'blocks' blocks between two devices, a run at a time.
+static bool copy_blocks(driver::BlockDevice *from, driver::BlockDevice *to,
+                        uint64_t blocks, uint8_t *buffer) {
+  for (uint64_t lba = 0; lba < blocks; lba += BENCH_COPY_BLOCKS) {
+    uint32_t count = blocks - lba < BENCH_COPY_BLOCKS ? (uint32_t)(blocks - lba)
+                                                      : BENCH_COPY_BLOCKS;
+    if (!from->read_blocks(lba, buffer, count) ||
+        !to->write_blocks(lba, buffer, count))
+      return false;
+  }
+  return true;
+}
+
+// Contents of file 'index', so a read can tell files apart.
+static void fill_pattern(uint8_t *data, uint32_t size, uint32_t index) {
+  for (uint32_t i = 0; i < size; i++)
+    data[i] = (uint8_t)(i * 7 + index * 13 + (i >> 9));
+}
+
+static void print_rate(const char *phase, double seconds, uint32_t files,
+                       uint64_t bytes) {
+  printf("%-6s %8.3f s  %9.1f files/s", phase, seconds, files / seconds);
+  if (bytes != 0)
+    printf("  %8.1f MiB/s", bytes / seconds / (1024 * 1024));
+  printf("\n");
+}
+
+static void usage() {
+  fprintf(stderr, "usage: fat32bench [-f size_mib] [-r] [-n files] "
+                  "[-s size_kib] image\n");
+}
+
+int main(int argc, char **argv) {
+  uint32_t format_mib = 0;
+  bool use_ram = false;
+  uint32_t files = 16;
+  uint32_t size_kib = 256;
+
+  int option;
+  while ((option = getopt(argc, argv, "f:rn:s:")) != -1) {
+    switch (option) {
+    case 'f':
+      format_mib = (uint32_t)atoi(optarg);
+      break;
+    case 'r':
+      use_ram = true;
+      break;
+    case 'n':
+      files = (uint32_t)atoi(optarg);
+      break;
+    case 's':
+      size_kib = (uint32_t)atoi(optarg);
+      break;
+    default:
+      usage();
+      return 2;
+    }
+  }
+  if (optind != argc - 1 || files == 0 || files > 999 || size_kib == 0) {
+    usage();
+    return 2;
+  }
+  const char *path = argv[optind];
+
+  if (format_mib != 0 && !format_image(path, format_mib))
+    return 1;
+
+  driver::FileBlockDevice image(path);
+  if (!image.is_open() || image.block_count() == 0) {
+    fprintf(stderr, "%s: cannot open the image\n", path);
+    return 1;
+  }
+
+  // The kernel heap serves the filesystem's allocations and the RAMDisk
+  size_t heap_bytes = BENCH_HEAP_BYTES;
+  if (use_ram)
+    heap_bytes += image.block_count() * BLOCK_SIZE;
+  void *arena = malloc(heap_bytes);
+  if (arena == 0) {
+    fprintf(stderr, "out of memory for the heap\n");
+    return 1;
+  }
+  memorymanagement::MemoryManager heap((size_t)arena, heap_bytes);
+
+  uint32_t size = size_kib * 1024;
+  uint8_t *data = (uint8_t *)malloc(size);
+  uint8_t *check = (uint8_t *)malloc(size);
+  uint8_t *copy_buffer = (uint8_t *)malloc(BENCH_COPY_BLOCKS * BLOCK_SIZE);
+  if (data == 0 || check == 0 || copy_buffer == 0) {
+    fprintf(stderr, "out of memory for the buffers\n");
+    return 1;
+  }
+
+  driver::BlockDevice *disk = &image;
+  driver::RAMDisk *ram = 0;
+  if (use_ram) {
+    ram = new driver::RAMDisk((uint32_t)image.block_count());
+    if (ram == 0 || ram->block_count() == 0 ||
+        !copy_blocks(&image, ram, image.block_count(), copy_buffer)) {
+      fprintf(stderr, "cannot load the image into a RAM disk\n");
+      return 1;
+    }
+    disk = ram;
+  }
+
+  filesystem::FAT32 fat32(disk, 0);
+  if (!fat32.initialize()) {
+    fprintf(stderr, "%s: not a FAT32 volume\n", path);
+    return 1;
+  }
+
+  char name[16];
+  uint32_t failures = 0;
+
+  double start = now();
+  for (uint32_t i = 0; i < files; i++) {
+    snprintf(name, sizeof(name), "/BENCH%03u.DAT", i);
+    fill_pattern(data, size, i);
+    int fd = fat32.touch(name) ? fat32.open(name) : -1;
+    if (fd < 0 || fat32.write(fd, data, size) != (int)size) {
+      fprintf(stderr, "write of %s failed\n", name);
+      failures++;
+    }
+    if (fd >= 0)
+      fat32.close(fd);
+  }
+  print_rate("write", now() - start, files, (uint64_t)files * size);
+
+  start = now();
+  for (uint32_t i = 0; i < files; i++) {
+    snprintf(name, sizeof(name), "/BENCH%03u.DAT", i);
+    fill_pattern(data, size, i);
+    int fd = fat32.open(name);
+    if (fd < 0 || fat32.read(fd, check, size) != (int)size ||
+        memcmp(data, check, size) != 0) {
+      fprintf(stderr, "read of %s failed or returned other data\n", name);
+      failures++;
+    }
+    if (fd >= 0)
+      fat32.close(fd);
+  }
+  print_rate("read", now() - start, files, (uint64_t)files * size);
+
+  uint32_t free_before = fat32.get_free_clusters();
+  start = now();
+  for (uint32_t i = 0; i < files; i++) {
+    snprintf(name, sizeof(name), "/BENCH%03u.DAT", i);
+    if (!fat32.rm(name)) {
+      fprintf(stderr, "rm of %s failed\n", name);
+      failures++;
+    }
+  }
+  print_rate("rm", now() - start, files, 0);
+
+  // Every cluster of the removed files must be free again
+  uint32_t cluster_bytes = fat32.get_cluster_size();
+  uint32_t file_clusters = (size + cluster_bytes - 1) / cluster_bytes;
+  if (fat32.get_free_clusters() != free_before + files * file_clusters) {
+    fprintf(stderr, "free clusters: %u, expected %u\n",
+            fat32.get_free_clusters(), free_before + files * file_clusters);
+    failures++;
+  }
+
+  if (!fat32.sync())
+    failures++;
+  if (ram != 0 && !copy_blocks(ram, &image, image.block_count(), copy_buffer))
+    failures++;
+  if (!image.flush())
+    failures++;
+
+  printf("%u files of %u KiB on %s: %s\n", files, size_kib,
+         use_ram ? "a RAM disk" : "the image file",
+         failures == 0 ? "OK" : "FAILED");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,67 @@
+#include "../include/libc/stdio.h"
+
+#include <stdio.h>
+
+/*
+ * Description: The kernel's console functions for the hosted build. They
+ * print to the host's standard output instead of the VGA text buffer and
+ * accept the same printf formats as the kernel (%s %d %x %c %%).
+ */
+
+namespace uqaabOS {
+namespace libc {
+
+void putchar(char c) { ::putchar(c); }
+
+void puts(const char *str) { ::fputs(str, stdout); }
+
+void print_int(int num) { ::printf("%d", num); }
+
+void print_hex(unsigned long num) { ::printf("0x%lX", num); }
+
+void printf(const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  for (; *format != '\0'; format++) {
+    if (*format != '%') {
+      putchar(*format);
+      continue;
+    }
+    format++;
+    switch (*format) {
+    case 's':
+      puts(va_arg(args, const char *));
+      break;
+    case 'd':
+      print_int(va_arg(args, int));
+      break;
+    case 'x':
+      print_hex(va_arg(args, uint32_t));
+      break;
+    case 'c':
+      putchar((char)va_arg(args, int));
+      break;
+    case '%':
+      putchar('%');
+      break;
+    case '\0':
+      format--;
+      break;
+    default:
+      putchar('%');
+      putchar(*format);
+      break;
+    }
+  }
+  va_end(args);
+}
+
+// No cursor or screen to manage on the host
+void init_cursor() {}
+
+void move_cursor(int, int) {}
+
+void clear_screen() {}
+
+} // namespace libc
+} // namespace uqaabOS
@@ -14,7 +14,7 @@ namespace uqaabOS
 
         enum BaseAdressRegisterType{
             memory_mapping = 0,
-            input_output = 0
+            input_output = 1
         };
 
         class BaseAdressRegister{
@@ -104,6 +104,12 @@ namespace uqaabOS
 
             BaseAdressRegister get_base_adress_register(uint16_t bus , uint16_t device , uint16_t function , uint16_t bar);
 
+            /*finds the first device of a class/subclass (e.g. 0x01/0x01 for an IDE controller).*/
+            bool find_device(uint8_t class_id, uint8_t sub_class_id, PeripheralComponentInterconnectDeviceDescriptor* result);
+
+            /*sets the bus master bit in the command register so the device can do DMA.*/
+            void enable_bus_mastering(PeripheralComponentInterconnectDeviceDescriptor* dev);
+
         };
     }
 }
@@ -0,0 +1,64 @@
+#ifndef __PIT_H
+#define __PIT_H
+
+#include <stdint.h>
+
+#include "../interrupts.h"
+#include "../multitasking/multitasking.h"
+#include "../port.h"
+#include "driver.h"
+
+namespace uqaabOS {
+
+namespace driver {
+
+// Input clock of the 8253/8254 PIT in Hz.
+#define PIT_BASE_FREQUENCY 1193182
+// Tick rate used unless another one is requested.
+#define PIT_DEFAULT_FREQUENCY 100
+
+/*
+ -> Programmable Interval Timer, channel 0, wired to IRQ0.
+ -> Counts ticks since activation and drives preemption: every tick is
+    charged to the running task, and the scheduler is only invoked when
+    that task's quantum is used up.
+*/
+class PITDriver : public interrupts::InterruptHandler, public Driver {
+private:
+  /*
+   -> 0x40: channel 0 data port (reload value, low byte then high byte)
+   -> 0x43: mode/command register
+  */
+  include::Port8Bit channel0_port;
+  include::Port8Bit command_port;
+
+  multitasking::TaskManager *task_manager;
+  uint32_t frequency;
+  volatile uint64_t ticks;
+
+public:
+  static PITDriver *active_timer;
+
+  PITDriver(interrupts::InterruptManager *manager,
+            multitasking::TaskManager *task_manager,
+            uint32_t frequency = PIT_DEFAULT_FREQUENCY);
+  ~PITDriver();
+
+  virtual uint32_t handle_interrupt(uint32_t esp);
+  virtual void activate();
+
+  // Reprograms channel 0; the rate is clamped to what the divisor allows.
+  void set_frequency(uint32_t frequency);
+  uint32_t get_frequency();
+
+  // Monotonic tick count since activation.
+  uint64_t get_ticks();
+
+  // Milliseconds since activation (wraps after ~49 days).
+  uint32_t uptime_ms();
+};
+
+} // namespace driver
+} // namespace uqaabOS
+
+#endif
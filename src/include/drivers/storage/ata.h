@@ -4,11 +4,29 @@
 #include "../../interrupts.h"
 #include "../../libc/stdio.h"
 #include "../../port.h"
+#include "blockdevice.h"
+#include "idedma.h"
 #include <stdint.h>
 
 namespace uqaabOS {
 namespace driver {
 
+// Status register bits.
+#define ATA_STATUS_ERR 0x01 // Error, details in the error register
+#define ATA_STATUS_DRQ 0x08 // Device is ready to transfer data
+#define ATA_STATUS_DF 0x20  // Device fault
+#define ATA_STATUS_BSY 0x80 // Device is busy, other bits are not valid
+
+// Most sectors a single 28-bit command can transfer (count register 0).
+#define ATA_MAX_SECTORS_PER_COMMAND 256
+// Most sectors a single 48-bit command can transfer.
+#define ATA_MAX_SECTORS_PER_COMMAND48 65536
+
+// How long a task waits for IRQ 14 before checking the status itself.
+#define ATA_IRQ_TIMEOUT_MS 3000
+// Status reads before a polled wait gives up.
+#define ATA_POLL_TIMEOUT 1000000
+
 /*
  * Description: This header file defines the ATA class for interfacing with ATA
  * storage devices. It provides methods to identify the ATA device, read and
@@ -17,8 +35,23 @@ namespace driver {
  * the hardware.
  */
 
+// What the drive reported in response to IDENTIFY.
+struct ATADeviceInfo {
+  bool present;
+  char model[41];             // Words 27-46, padding stripped
+  char serial[21];            // Words 10-19
+  bool lba48;                 // 48-bit addressing supported
+  uint32_t sectors28;         // Sectors reachable with 28-bit commands
+  uint64_t sector_count;      // Total user-addressable sectors
+  uint32_t bytes_per_sector;  // Logical sector size
+  uint8_t max_multiple;       // Largest READ/WRITE MULTIPLE block, 0/1 = none
+  bool dma;                   // DMA supported
+  uint8_t multiword_dma_modes; // Bit n = Multiword DMA mode n supported
+  uint8_t ultra_dma_modes;     // Bit n = Ultra DMA mode n supported
+};
+
 // ATA class for interfacing with ATA storage devices.
-class ATA : public uqaabOS::interrupts::InterruptHandler {
+class ATA : public uqaabOS::interrupts::InterruptHandler, public BlockDevice {
 protected:
   bool master; // Boolean flag indicating if the device is the master drive.
   uint16_t bytes_per_sector; // Number of bytes per sector (default 512).
@@ -35,6 +68,44 @@ protected:
   include::Port8Bit device_port;  // 8-bit device register port(0x1F6/0x176).
   include::Port8Bit command_port; // 8-bit command register port(0x1F7/0x177).
   include::Port8Bit control_port; // 8-bit control register port(0x3F6/0x376).
+
+  // Completion signalling from IRQ 14: the handler latches the status
+  // register and wakes every task waiting on irq_queue.
+  volatile bool irq_received;
+  volatile uint8_t irq_status;
+  multitasking::WaitQueue irq_queue;
+
+  // Block on irq_queue for completions (true) or poll the status (false).
+  bool interrupt_driven;
+
+  // Sectors per DRQ block for READ/WRITE MULTIPLE, 1 = multiple mode off.
+  uint8_t multiple_sectors;
+
+  // Bus-master DMA engine of this channel, 0 = PIO only.
+  IDEBusMaster *dma;
+
+  // Filled by identify().
+  ATADeviceInfo info;
+
+  // Shared body of the 28- and 48-bit whole-sector transfers.
+  bool transfer(uint64_t sector_num, uint8_t *data, uint32_t sector_count,
+                bool write, bool lba48);
+
+  // Polls the alternate status until BSY clears; returns the last status.
+  uint8_t wait_not_busy();
+
+  // Selects the drive and LBA, then issues 'command' for 'count' sectors.
+  void issue_command28(uint8_t command, uint32_t sector_num, uint8_t count);
+  // Same with 48-bit LBA and a 16-bit count.
+  void issue_command48(uint8_t command, uint64_t sector_num, uint16_t count);
+
+  // Waits for the IRQ of the command in flight and returns its status.
+  // Sleeps on irq_queue when called from a task with interrupts enabled,
+  // and polls otherwise (boot, interrupt context, interrupt_driven off).
+  uint8_t wait_for_interrupt();
+
+  // Checks a completion status; prints and returns false on failure.
+  bool check_status(uint8_t status, bool expect_data, const char *operation);
 public:
   // Constructor: Initializes ATA object with master/slave flag and base I/O
   // port.
@@ -45,17 +116,73 @@ public:
   // Handle interrupt for ATA device
   virtual uint32_t handle_interrupt(uint32_t esp);
 
-  // Sends the IDENTIFY command to the ATA device and prints its information.
-  void identify();
+  // Sends the IDENTIFY command to the ATA device, records and prints its
+  // information and enables multiple mode with the largest block the drive
+  // supports. Returns false if no drive answered.
+  bool identify();
+  const ATADeviceInfo *get_device_info();
+
+  // Sets the READ/WRITE MULTIPLE block size (SET MULTIPLE MODE, 0xC6).
+  bool set_multiple_mode(uint8_t sectors);
+  uint8_t get_multiple_sectors();
+
+  // Routes read_sectors28/write_sectors28 through bus-master DMA. Fails if
+  // IDENTIFY did not report DMA support; pass 0 to go back to PIO.
+  bool attach_dma(IDEBusMaster *dma);
+
+  // Selects interrupt-driven (default) or polled completion.
+  void set_interrupt_driven(bool enabled);
 
   // Reads data from one sector of the device using 28-bit LBA addressing.
   void read28(uint32_t sector_num, uint8_t* data, uint32_t count);
 
   // Writes data to one sector of the device using 28-bit LBA addressing.
   void write28(uint32_t sector_num, uint8_t *data, uint32_t count);
+
+  /*
+   * Transfer 'sector_count' (1..ATA_MAX_SECTORS_PER_COMMAND) whole sectors
+   * with a single command. READ/WRITE MULTIPLE is used once identify() has
+   * enabled multiple mode, so the drive interrupts once per block instead
+   * of once per sector. With a DMA engine attached the data bypasses the
+   * CPU entirely, except for buffers the engine cannot reach.
+   */
+  bool read_sectors28(uint32_t sector_num, uint8_t *data,
+                      uint32_t sector_count);
+  bool write_sectors28(uint32_t sector_num, uint8_t *data,
+                       uint32_t sector_count);
+
+  // 48-bit LBA versions, 1..ATA_MAX_SECTORS_PER_COMMAND48 sectors anywhere
+  // on the drive. Need info.lba48.
+  bool read48(uint64_t sector_num, uint8_t *data, uint32_t sector_count);
+  bool write48(uint64_t sector_num, uint8_t *data, uint32_t sector_count);
+
+  // Use the 28-bit commands where they reach and the 48-bit ones beyond;
+  // sector_count may be up to max_sectors_per_command().
+  bool read_sectors(uint64_t sector_num, uint8_t *data, uint32_t sector_count);
+  bool write_sectors(uint64_t sector_num, uint8_t *data, uint32_t sector_count);
+  uint32_t max_sectors_per_command();
+
+  /*
+   * Split transfers: begin_* issues the command and returns without waiting
+   * for the drive, end_* waits for IRQ 14 and finishes the transfer. The
+   * caller may do other work in between and use transfer_complete() to see
+   * whether end_* would block. Only one transfer may be in flight.
+   */
+  bool begin_read28(uint32_t sector_num);
+  bool end_read28(uint8_t *data, uint32_t count);
+  bool begin_write28(uint32_t sector_num, uint8_t *data, uint32_t count);
+  bool end_write28();
+  bool transfer_complete();
   
+  // BlockDevice: whole sectors through read_sectors/write_sectors, split
+  // at max_sectors_per_command(), or IDE_DMA_MAX_SECTORS when DMA is on.
+  virtual bool read_blocks(uint64_t lba, uint8_t *buffer, uint32_t count);
+  virtual bool write_blocks(uint64_t lba, uint8_t *buffer, uint32_t count);
+  virtual uint64_t block_count();
+  virtual uint32_t max_blocks_per_request();
+
   // Flushes the ATA device's write cache.
-  void flush();
+  virtual bool flush();
 };
 
 } // namespace driver
@@ -0,0 +1,76 @@
+#ifndef __DRIVERS__BLOCKDEVICE_H
+#define __DRIVERS__BLOCKDEVICE_H
+
+#include <stdint.h>
+
+namespace uqaabOS {
+namespace driver {
+
+/*
+ * Description: Interface of anything that stores fixed-size blocks addressed
+ * by LBA: the ATA driver, a RAM disk, or (in the hosted build) a disk image
+ * file. The filesystem and the block request queue only use this
+ * interface, so they run unchanged on any of them.
+ */
+
+// Bytes per block; the filesystem code assumes 512-byte sectors.
+#define BLOCK_SIZE 512
+
+struct BlockRequest;
+
+// Called once a request has completed, in the context of the task that
+// dispatched it. May submit new requests but must not wait on them.
+typedef void (*BlockRequestCallback)(BlockRequest *request);
+
+struct BlockRequest {
+  uint64_t lba;
+  uint8_t *buffer;       // sector_count * 512 bytes
+  uint32_t sector_count;
+  bool write;
+
+  BlockRequestCallback callback; // Optional
+  void *context;                 // For the callback's use
+
+  volatile bool done;
+  bool success;
+
+  BlockRequest *next; // Link in the pending list, then in a dispatched batch
+
+  BlockRequest(); // An empty request, for arrays filled in later
+  BlockRequest(uint64_t lba, uint8_t *buffer, uint32_t sector_count,
+               bool write, BlockRequestCallback callback = 0,
+               void *context = 0);
+};
+
+class BlockDevice {
+public:
+  BlockDevice();
+  ~BlockDevice();
+
+  // Transfer 'count' whole blocks starting at 'lba'. Requests larger than
+  // max_blocks_per_request() are split by the device itself.
+  virtual bool read_blocks(uint64_t lba, uint8_t *buffer, uint32_t count);
+  virtual bool write_blocks(uint64_t lba, uint8_t *buffer, uint32_t count);
+
+  // Makes completed writes durable (drive write cache, host page cache).
+  virtual bool flush();
+
+  // Size of the device in blocks.
+  virtual uint64_t block_count();
+
+  // Largest count the device moves in one operation.
+  virtual uint32_t max_blocks_per_request();
+
+  // Asynchronous requests: submit() may return before the transfer is
+  // done, and the request must stay valid until wait() has returned for
+  // it. Submitting several requests before waiting lets a queued device
+  // sort and merge them. Here the transfer runs at once through
+  // read_blocks/write_blocks.
+  virtual void submit(BlockRequest *request);
+  virtual bool wait(BlockRequest *request); // The request's result
+};
+
+} // namespace driver
+} // namespace uqaabOS
+
+#endif // __DRIVERS__BLOCKDEVICE_H
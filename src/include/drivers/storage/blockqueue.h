@@ -0,0 +1,96 @@
+#ifndef __DRIVERS__BLOCKQUEUE_H
+#define __DRIVERS__BLOCKQUEUE_H
+
+#include "../../multitasking/multitasking.h"
+#include "blockdevice.h"
+#include <stdint.h>
+
+namespace uqaabOS {
+namespace driver {
+
+/*
+ * Description: Block-layer request queue between the filesystem and a block
+ * device. Requests are submitted asynchronously and kept sorted by LBA. They
+ * are dispatched in C-LOOK order: ascending from the last position, then
+ * wrapping to the lowest LBA. Runs of adjacent requests in the same
+ * direction are merged into a single disk command.
+ */
+
+// Largest merged command, in sectors; also the size of the bounce buffer
+// used when the merged requests' buffers are not contiguous in memory.
+#define BLOCK_QUEUE_MAX_MERGE_SECTORS 128
+
+struct BlockQueueStatistics {
+  uint32_t requests;        // Requests submitted
+  uint32_t commands;        // Batches handed to the device for them
+  uint32_t merged_requests; // Requests that rode along in another's command
+  uint32_t bounced_commands; // Batches that needed the bounce buffer
+};
+
+// A BlockDevice itself: read_blocks/write_blocks are synchronous requests,
+// so the queue can be stacked under the buffer cache or a filesystem.
+class BlockRequestQueue : public BlockDevice {
+private:
+  BlockDevice *disk;
+
+  BlockRequest *pending;  // Sorted by LBA, FIFO among equal LBAs
+  uint64_t head_position; // LBA just past the last dispatched command
+
+  bool dispatching;    // A task is inside dispatch_next()
+  bool worker_running; // run() is serving the queue
+
+  multitasking::WaitQueue work_queue;       // The worker waits for requests
+  multitasking::WaitQueue completion_queue; // wait() callers
+
+  uint8_t *merge_buffer; // BLOCK_QUEUE_MAX_MERGE_SECTORS sectors
+  BlockQueueStatistics stats;
+
+  // Takes the next batch off the pending list and runs it. Returns false
+  // if nothing was pending.
+  bool dispatch_next();
+
+  void complete(BlockRequest *request, bool success);
+  void end_dispatch();
+
+  // Adds 'request' to the pending list. Synchronous callers do not wake
+  // the worker, since they dispatch the request themselves.
+  void enqueue(BlockRequest *request, bool wake_worker);
+
+public:
+  BlockRequestQueue(BlockDevice *disk);
+  ~BlockRequestQueue();
+
+  // Queues 'request' and returns at once. The request must stay valid
+  // until it is done. Overlapping requests in flight together are not
+  // ordered against each other.
+  virtual void submit(BlockRequest *request);
+
+  // Waits until 'request' is done and returns its result. Unless another
+  // task is dispatching, the caller dispatches pending requests itself, in
+  // elevator order.
+  virtual bool wait(BlockRequest *request);
+
+  // Returns once every request submitted so far is done.
+  void drain();
+
+  // Synchronous helpers: submit one request and wait for it.
+  bool read(uint64_t lba, uint8_t *buffer, uint32_t sector_count);
+  bool write(uint64_t lba, uint8_t *buffer, uint32_t sector_count);
+
+  // Worker loop for a dedicated kernel task; never returns. Once it runs,
+  // asynchronous submissions are dispatched in the background.
+  void run();
+
+  virtual bool read_blocks(uint64_t lba, uint8_t *buffer, uint32_t count);
+  virtual bool write_blocks(uint64_t lba, uint8_t *buffer, uint32_t count);
+  virtual bool flush(); // drain(), then flushes the device
+  virtual uint64_t block_count();
+  virtual uint32_t max_blocks_per_request();
+
+  BlockQueueStatistics statistics();
+};
+
+} // namespace driver
+} // namespace uqaabOS
+
+#endif // __DRIVERS__BLOCKQUEUE_H
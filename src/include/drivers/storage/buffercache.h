@@ -0,0 +1,142 @@
+#ifndef __DRIVERS__BUFFERCACHE_H
+#define __DRIVERS__BUFFERCACHE_H
+
+#include "../../multitasking/multitasking.h"
+#include "blockdevice.h"
+#include <stdint.h>
+
+namespace uqaabOS {
+namespace driver {
+
+/*
+ * Description: Block buffer cache. Keeps recently used blocks of a lower
+ * BlockDevice in memory, found through a hash table keyed by LBA and
+ * recycled in least-recently-used order. It is a BlockDevice itself, so it
+ * stacks between the filesystem and the disk (or its request queue).
+ *
+ * Writes go through to the device by default. In write-back mode they only
+ * update the cached copy and mark it dirty; dirty blocks are written in LBA
+ * order, adjacent ones in a single request, by sync(), when the cache runs
+ * short of clean buffers, and from a periodic flusher task.
+ */
+
+// Blocks cached when no capacity is given (128 KiB).
+#define BUFFER_CACHE_DEFAULT_BLOCKS 256
+
+// Largest run of adjacent dirty blocks written back in one request; also
+// the size of the gather buffer.
+#define BUFFER_CACHE_WRITEBACK_BLOCKS 32
+
+// How often the flusher task writes dirty blocks back.
+#define BUFFER_CACHE_FLUSH_INTERVAL_MS 5000
+
+struct CacheBuffer {
+  uint64_t lba;
+  uint8_t *data; // BLOCK_SIZE bytes
+  bool valid;    // Holds the contents of 'lba'
+  bool dirty;    // Newer than the block on the device
+
+  CacheBuffer *hash_next; // Chain in the hash bucket
+  CacheBuffer *lru_prev;  // Towards the most recently used end
+  CacheBuffer *lru_next;  // Towards the least recently used end
+  CacheBuffer *dirty_next; // Next dirty buffer by LBA
+};
+
+struct BufferCacheStatistics {
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t evictions;  // Valid blocks dropped to make room
+  uint32_t bypassed;   // Blocks of long reads that were not cached
+  uint32_t coalesced;  // Writes to blocks that were already dirty
+  uint32_t written_back;       // Dirty blocks written to the device
+  uint32_t writeback_requests; // Device writes used for them
+};
+
+class BufferCache : public BlockDevice {
+private:
+  BlockDevice *disk;
+  uint32_t capacity;
+
+  CacheBuffer *buffers;  // 'capacity' headers
+  uint8_t *block_memory; // 'capacity' * BLOCK_SIZE bytes
+
+  CacheBuffer **hash_table;
+  uint32_t hash_mask; // Bucket count - 1 (a power of two)
+
+  CacheBuffer *lru_head; // Most recently used
+  CacheBuffer *lru_tail; // Next to be recycled; invalid buffers sit here
+
+  bool write_back;
+  CacheBuffer *dirty_list; // Sorted by LBA
+  uint32_t dirty_count;
+  uint8_t *writeback_buffer; // BUFFER_CACHE_WRITEBACK_BLOCKS blocks
+  BlockRequest writeback_batch[BUFFER_CACHE_WRITEBACK_BLOCKS]; // One per run
+
+  // Serializes users of the cache; held across device I/O.
+  bool busy;
+  multitasking::WaitQueue lock_queue;
+
+  BufferCacheStatistics stats;
+
+  bool lock(); // False if the lock is held and the caller cannot wait
+  void unlock();
+
+  uint32_t hash(uint64_t lba);
+  CacheBuffer *lookup(uint64_t lba);
+  void unhash(CacheBuffer *buffer);
+  void move_to_head(CacheBuffer *buffer);
+  void move_to_tail(CacheBuffer *buffer);
+  void mark_dirty(CacheBuffer *buffer);
+  void unlink_dirty(CacheBuffer *buffer);
+  void discard(CacheBuffer *buffer);
+
+  // Stores a copy of 'data' as block 'lba', recycling the LRU buffer.
+  // Returns 0 if that buffer is dirty and cannot be written back.
+  CacheBuffer *insert(uint64_t lba, const uint8_t *data);
+
+  // Writes every dirty block back in LBA order, merging adjacent blocks.
+  // Each batch of runs is submitted together and then waited for. Blocks
+  // whose write fails stay dirty.
+  bool write_back_dirty();
+
+public:
+  // Static pointer to the cache reported by the 'cacheinfo' command.
+  static BufferCache *active_cache;
+
+  // Caches 'capacity' blocks of 'disk'. If the memory cannot be allocated
+  // the cache passes every request straight through.
+  BufferCache(BlockDevice *disk,
+              uint32_t capacity = BUFFER_CACHE_DEFAULT_BLOCKS);
+  ~BufferCache();
+
+  virtual bool read_blocks(uint64_t lba, uint8_t *buffer, uint32_t count);
+  virtual bool write_blocks(uint64_t lba, uint8_t *buffer, uint32_t count);
+  virtual bool flush(); // sync(), then flushes the device
+  virtual uint64_t block_count();
+  virtual uint32_t max_blocks_per_request();
+  virtual void submit(BlockRequest *request);
+  virtual bool wait(BlockRequest *request);
+
+  // Switching write-back off writes the dirty blocks first.
+  void set_write_back(bool enabled);
+  bool is_write_back();
+
+  // Writes all dirty blocks to the device.
+  bool sync();
+
+  // Flusher loop for a dedicated kernel task; never returns.
+  void run_flusher();
+
+  // Writes back, then drops every cached block.
+  void invalidate();
+
+  uint32_t get_capacity();
+  uint32_t dirty_blocks();
+  BufferCacheStatistics statistics();
+  void print_statistics();
+};
+
+} // namespace driver
+} // namespace uqaabOS
+
+#endif // __DRIVERS__BUFFERCACHE_H
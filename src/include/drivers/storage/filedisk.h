@@ -0,0 +1,38 @@
+#ifndef __DRIVERS__FILEDISK_H
+#define __DRIVERS__FILEDISK_H
+
+#include "blockdevice.h"
+#include <stdint.h>
+
+namespace uqaabOS {
+namespace driver {
+
+/*
+ * Description: Block device backed by a disk image file on the host. Only
+ * the hosted build ('make hosted') compiles it, since it uses the host C
+ * library; there the filesystem code runs and is benchmarked as an
+ * ordinary process against e.g. the image QEMU boots from.
+ */
+class FileBlockDevice : public BlockDevice {
+private:
+  int fd;
+  uint64_t blocks;
+
+public:
+  // Opens 'path' read-write (read-only if 'read_only'); is_open() reports
+  // whether that worked. The image size is rounded down to whole blocks.
+  FileBlockDevice(const char *path, bool read_only = false);
+  ~FileBlockDevice();
+
+  bool is_open();
+
+  virtual bool read_blocks(uint64_t lba, uint8_t *buffer, uint32_t count);
+  virtual bool write_blocks(uint64_t lba, uint8_t *buffer, uint32_t count);
+  virtual bool flush();
+  virtual uint64_t block_count();
+};
+
+} // namespace driver
+} // namespace uqaabOS
+
+#endif // __DRIVERS__FILEDISK_H
@@ -0,0 +1,79 @@
+#ifndef __DRIVERS__IDEDMA_H
+#define __DRIVERS__IDEDMA_H
+
+#include "../../port.h"
+#include <stdint.h>
+
+namespace uqaabOS {
+namespace driver {
+
+/*
+ * Description: Bus-master DMA engine of a PCI IDE controller (PIIX3/PIIX4 and
+ * compatibles). BAR4 of the IDE function holds two blocks of 8 registers, one
+ * per channel. The engine walks a Physical Region Descriptor (PRD) table and
+ * moves sector data between the drive and memory without the CPU; the drive
+ * signals the end of the transfer with its normal IRQ.
+ */
+
+// Bus-master command register bits.
+#define IDE_BM_COMMAND_START 0x01
+#define IDE_BM_COMMAND_READ 0x08 // Direction: device to memory
+
+// Bus-master status register bits (ERROR and IRQ are cleared by writing 1).
+#define IDE_BM_STATUS_ACTIVE 0x01
+#define IDE_BM_STATUS_ERROR 0x02
+#define IDE_BM_STATUS_IRQ 0x04
+
+// Set in the flags of the last descriptor of a table.
+#define IDE_PRD_END_OF_TABLE 0x8000
+// Descriptors per table: 512 bytes, enough for a 128 KiB transfer split
+// on every page.
+#define IDE_PRD_ENTRIES 64
+// Sectors per DMA command: 128 KiB needs at most 33 descriptors even when
+// the buffer is not page aligned, so one table always describes it.
+#define IDE_DMA_MAX_SECTORS 256
+
+// One region of memory for the DMA engine. A region may not cross a 64 KiB
+// boundary; a byte_count of 0 means 64 KiB.
+struct PhysicalRegionDescriptor {
+  uint32_t address;
+  uint16_t byte_count;
+  uint16_t flags;
+} __attribute__((packed));
+
+class IDEBusMaster {
+private:
+  include::Port8Bit command_port; // base + 0
+  include::Port8Bit status_port;  // base + 2
+  include::Port32Bit prd_port;    // base + 4, physical address of the table
+
+  PhysicalRegionDescriptor *prd_table;
+
+  // Physical address of 'virtual_address' in the current address space.
+  static uint32_t physical_address(uint32_t virtual_address);
+
+public:
+  /*
+   * port_base: BAR4 of the IDE function.
+   * channel:   0 = primary, 1 = secondary; selects the register block and
+   *            the PRD table.
+   */
+  IDEBusMaster(uint16_t port_base, uint8_t channel);
+  ~IDEBusMaster();
+
+  // Builds the PRD table for 'buffer' and programs the direction. Returns
+  // false if the buffer cannot be used for DMA (odd address or size,
+  // unmapped pages, too fragmented); the caller then falls back to PIO.
+  bool prepare(uint8_t *buffer, uint32_t size, bool to_memory);
+
+  // Starts the engine; issue the drive's DMA command first.
+  void start();
+
+  // Stops the engine and acknowledges it; returns the bus-master status.
+  uint8_t stop();
+};
+
+} // namespace driver
+} // namespace uqaabOS
+
+#endif // __DRIVERS__IDEDMA_H
@@ -0,0 +1,39 @@
+#ifndef __DRIVERS__RAMDISK_H
+#define __DRIVERS__RAMDISK_H
+
+#include "blockdevice.h"
+#include <stdint.h>
+
+namespace uqaabOS {
+namespace driver {
+
+/*
+ * Description: Block device kept entirely in memory. Useful for exercising
+ * and benchmarking the filesystem without a disk driver in the path; a
+ * FAT32 image can be loaded into it (e.g. from a multiboot module).
+ */
+class RAMDisk : public BlockDevice {
+private:
+  uint8_t *memory;
+  uint32_t blocks;
+  bool owns_memory; // 'memory' came from the heap in the constructor
+
+public:
+  // Uses 'memory' (block_count * BLOCK_SIZE bytes) if given, otherwise
+  // allocates and zeroes it. block_count() is 0 if the allocation failed.
+  RAMDisk(uint32_t block_count, uint8_t *memory = 0);
+  ~RAMDisk();
+
+  virtual bool read_blocks(uint64_t lba, uint8_t *buffer, uint32_t count);
+  virtual bool write_blocks(uint64_t lba, uint8_t *buffer, uint32_t count);
+  virtual bool flush();
+  virtual uint64_t block_count();
+
+  // Start of the backing memory.
+  uint8_t *data();
+};
+
+} // namespace driver
+} // namespace uqaabOS
+
+#endif // __DRIVERS__RAMDISK_H
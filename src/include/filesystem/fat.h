@@ -1,7 +1,7 @@
 #ifndef __FILESYSTEM__FAT_h
 #define __FILESYSTEM__FAT_h
 
-#include "../drivers/storage/ata.h"
+#include "../drivers/storage/blockdevice.h"
 #include "../libc/stdio.h"
 
 namespace uqaabOS {
@@ -46,6 +46,32 @@ struct BiosParameterBlock32 {
 
 } __attribute__((packed));
 
+// FSInfo signatures and the "unknown" value of its two fields.
+#define FAT32_FSINFO_LEAD_SIGNATURE 0x41615252
+#define FAT32_FSINFO_STRUCT_SIGNATURE 0x61417272
+#define FAT32_FSINFO_TRAIL_SIGNATURE 0xAA550000
+#define FAT32_FSINFO_UNKNOWN 0xFFFFFFFF
+
+/**
+ * FSInfo32
+ * The FSInfo sector of a FAT32 filesystem (sector bpb.fat_info of the
+ * partition).
+ *
+ * It caches the number of free clusters and a hint for where to start
+ * looking for the next free one. Both are advisory: they may be stale after
+ * an unclean shutdown, and FAT32_FSINFO_UNKNOWN means not known.
+ */
+struct FSInfo32 {
+  uint32_t lead_signature;          // FAT32_FSINFO_LEAD_SIGNATURE
+  uint8_t reserved0[480];           // Reserved, zero
+  uint32_t struct_signature;        // FAT32_FSINFO_STRUCT_SIGNATURE
+  uint32_t free_count;              // Free clusters, or FAT32_FSINFO_UNKNOWN
+  uint32_t next_free;               // Allocation hint, or FAT32_FSINFO_UNKNOWN
+  uint8_t reserved1[12];            // Reserved, zero
+  uint32_t trail_signature;         // FAT32_FSINFO_TRAIL_SIGNATURE
+
+} __attribute__((packed));
+
 /**
  * DirectoryEntryFat32
  * Represents a directory entry in a FAT32 filesystem.
@@ -72,7 +98,7 @@ struct DirectoryEntryFat32 {
 } __attribute__((packed));
 
 // function
-void read_bios_parameter_block(driver::ATA *hd, uint32_t parition_offset);
+void read_bios_parameter_block(driver::BlockDevice *hd, uint32_t parition_offset);
 } 
 } 
 
@@ -1,8 +1,9 @@
 #ifndef __FILESYSTEM__FAT32_H
 #define __FILESYSTEM__FAT32_H
 
-#include "../drivers/storage/ata.h"
+#include "../drivers/storage/blockdevice.h"
 #include "../libc/stdio.h"
+#include "../memorymanagement/slab.h"
 #include "fat.h"
 
 namespace uqaabOS {
@@ -11,6 +12,37 @@ namespace filesystem {
 // Maximum number of open files
 #define FAT32_MAX_OPEN_FILES 16
 
+// Size of the scratch buffers used to hold one directory cluster
+// (large enough for the biggest cluster, 32 sectors)
+#define FAT32_CLUSTER_BUFFER_SIZE (512 * 32)
+
+// Largest FAT kept in memory by initialize(true) (covers a 16 GiB volume
+// with 4 KiB clusters); bigger FATs are read through the block cache.
+#define FAT32_FAT_CACHE_MAX_BYTES (16 * 1024 * 1024)
+
+// Sectors per read while loading the FAT. Longer than a quarter of the
+// block cache, so the load does not flush it.
+#define FAT32_FAT_LOAD_SECTORS 128
+
+// Writes submitted before waiting for them, by write() for whole sectors
+// of file data and by free_cluster_chain() for FAT sectors
+#define FAT32_WRITE_BATCH 8
+
+// lseek() origins
+#define FAT32_SEEK_SET 0 // From the start of the file
+#define FAT32_SEEK_CUR 1 // From the current position
+#define FAT32_SEEK_END 2 // From the end of the file
+
+// Extents the map of an open file starts with; it doubles as needed
+#define FAT32_INITIAL_FILE_EXTENTS 8
+
+// A run of physically contiguous clusters in a file's chain
+struct FileExtent {
+    uint32_t file_cluster;  // Index of the run's first cluster within the file
+    uint32_t start_cluster; // Cluster number on disk
+    uint32_t length;        // In clusters
+};
+
 // File descriptor structure
 struct FileDescriptor {
     char name[256];
@@ -21,11 +53,18 @@ struct FileDescriptor {
     uint32_t size;
     uint32_t position;
     bool is_open;
+    
+    // Extent map of the cluster chain, built on first use
+    FileExtent* extents;
+    uint32_t extent_count;
+    uint32_t extent_capacity;
+    uint32_t mapped_clusters; // Clusters covered by the map
+    bool extents_valid;
 };
 
 class FAT32 {
 private:
-    driver::ATA* disk;
+    driver::BlockDevice* disk; // Usually the buffer cache over the disk's queue
     uint32_t partition_lba;
     
     // BPB information
@@ -37,25 +76,71 @@ private:
     uint32_t data_start;
     uint32_t root_cluster;
     
+    // In-memory copy of the first FAT (fat_size * 128 entries), or 0
+    uint32_t* fat_table;
+    uint32_t fat_entries;
+    
+    // Free-space accounting
+    uint32_t cluster_count;   // Data clusters + 2 (valid numbers are 2..cluster_count-1)
+    uint32_t* free_bitmap;    // One bit per cluster, set = free; 0 if not built
+    uint32_t free_clusters;   // FAT32_FSINFO_UNKNOWN if not known
+    uint32_t next_free_hint;  // Where the next free-cluster search starts
+    bool fsinfo_valid;        // The FSInfo sector exists and has its signatures
+    bool fsinfo_dirty;        // free_clusters/next_free_hint differ from the disk
+    
     // Open file descriptors
     FileDescriptor file_descriptors[FAT32_MAX_OPEN_FILES];
+
+    // Slab cache for cluster-sized scratch buffers
+    memorymanagement::KmemCache* cluster_buffer_cache;
     
     // Private helper methods
     uint32_t get_next_cluster(uint32_t cluster);
+    bool load_fat(); // Read the whole FAT into fat_table
+    bool build_free_bitmap(); // Scan the FAT once and mark the free clusters
+    void read_fsinfo();
+    bool write_fsinfo();
+    void cluster_state_changed(uint32_t cluster, bool was_free, bool now_free);
     bool read_cluster(uint32_t cluster, uint8_t* buffer);
     bool find_file_in_root(const char* name, DirectoryEntryFat32* entry);
     uint32_t cluster_to_lba(uint32_t cluster);
     bool read_sector(uint32_t lba, uint8_t* buffer);
+    bool read_sectors(uint32_t lba, uint8_t* buffer, uint32_t count); // One disk command for 'count' sectors
     int strcasecmp(const char* str1, const char* str2); // Case-insensitive string comparison
     int strncasecmp(const char* str1, const char* str2, uint32_t n); // Case-insensitive string comparison
+    uint8_t* alloc_cluster_buffer(); // Get a FAT32_CLUSTER_BUFFER_SIZE scratch buffer
+    void free_cluster_buffer(uint8_t* buffer); // Return a scratch buffer
     
     // New helper methods for write operations
     bool write_sector(uint32_t lba, uint8_t* buffer);
+    bool write_sectors(uint32_t lba, uint8_t* buffer, uint32_t count);
+    // Start a write without waiting for it; 'request' must stay valid
+    // until wait_writes() returns
+    void submit_write(driver::BlockRequest* request, uint32_t lba, uint8_t* buffer, uint32_t count);
+    // Wait for 'count' submitted writes; the index of the first that failed, or 'count'
+    uint32_t wait_writes(driver::BlockRequest* requests, uint32_t count);
     bool write_cluster(uint32_t cluster, uint8_t* buffer);
+    bool zero_cluster(uint32_t cluster); // Fill a newly allocated cluster with zeros
     bool set_next_cluster(uint32_t cluster, uint32_t next_cluster);
     uint32_t find_free_cluster();
     bool allocate_cluster(uint32_t* cluster);
+    // Best-fit run of up to 'wanted' free clusters, preferring one at 'goal'
+    bool find_free_extent(uint32_t wanted, uint32_t goal, uint32_t* start, uint32_t* length);
+    // Allocate a contiguous run, chain it and link 'previous' (if not 0) to it
+    bool allocate_extent(uint32_t previous, uint32_t wanted, uint32_t* start, uint32_t* length);
+    bool write_fat_range(uint32_t first_cluster, uint32_t last_cluster);
+    bool submit_fat_range(driver::BlockRequest* requests, uint32_t* batched, uint32_t first_sector, uint32_t last_sector);
     bool free_cluster_chain(uint32_t start_cluster);
+    void trim_chain(FileDescriptor* file); // Free clusters reserved past the end of the file
+    
+    // Per-file extent maps (fat32_extent_map.cpp)
+    bool build_extent_map(FileDescriptor* file);
+    bool append_extent(FileDescriptor* file, uint32_t start_cluster, uint32_t length);
+    void free_extent_map(FileDescriptor* file);
+    // Cluster holding the file's cluster 'index', and how many clusters
+    // from there on are contiguous on disk
+    bool map_cluster(FileDescriptor* file, uint32_t index, uint32_t* cluster, uint32_t* run);
+    void update_cursor(FileDescriptor* file); // current_cluster/sector from position
     
     // Helper for path traversal
     bool find_file_in_directory(uint32_t dir_cluster, const char* name, DirectoryEntryFat32* entry, uint32_t* entry_cluster, uint32_t* entry_offset);
@@ -65,10 +150,20 @@ private:
     
 public:
     // Constructor
-    FAT32(driver::ATA* disk, uint32_t partition_lba);
+    FAT32(driver::BlockDevice* disk, uint32_t partition_lba);
     
-    // Initialize the FAT32 filesystem
-    bool initialize();
+    // Initialize the FAT32 filesystem. With cache_fat, the FAT is also
+    // loaded into memory (if it fits) for chain walks and allocation.
+    bool initialize(bool cache_fat = true);
+    
+    // Write all cached changes to the disk
+    bool sync();
+    
+    // Free space
+    uint32_t get_total_clusters();
+    uint32_t get_free_clusters();
+    uint32_t get_cluster_size(); // In bytes
+    void df(); // Print size, used and free space
     
     // Open a file and return a file descriptor
     int open(const char* path);
@@ -76,6 +171,14 @@ public:
     // Read data from a file
     int read(int fd, uint8_t* buf, uint32_t size);
     
+    // Move the file position; returns the new position or -1. Positions
+    // past the end of the file are rejected.
+    int lseek(int fd, int32_t offset, int whence);
+    
+    // Read/write at 'offset' without moving the file position
+    int pread(int fd, uint8_t* buf, uint32_t size, uint32_t offset);
+    int pwrite(int fd, uint8_t* buf, uint32_t size, uint32_t offset);
+    
     // Close a file
     void close(int fd);
     
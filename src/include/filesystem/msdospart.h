@@ -1,7 +1,7 @@
 #ifndef __FILESYSTEM__MSDOSPART_H 
 #define __FILESYSTEM__MSDOSPART_H
 
-#include "../drivers/storage/ata.h" 
+#include "../drivers/storage/blockdevice.h"
 #include "../libc/stdio.h"
 
 namespace uqaabOS 
@@ -42,8 +42,8 @@ namespace uqaabOS
         class MSDOSPartitionTable
         {
             public:
-                static void read_partitions(driver::ATA *hd); // Static method to read partitions from an ATA hard drive
-                static uint32_t get_first_fat32_partition_lba(driver::ATA *hd); // Get LBA of first FAT32 partition
+                static void read_partitions(driver::BlockDevice *hd); // Static method to read partitions from a disk
+                static uint32_t get_first_fat32_partition_lba(driver::BlockDevice *hd); // Get LBA of first FAT32 partition
         };
     }
 }
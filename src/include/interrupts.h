@@ -153,6 +153,13 @@ public:
   void deactivate(); // deactivate the interrupts
   uint32_t do_handle_interrupt(uint8_t interrupt_number, uint32_t esp);
 
+  // True while an interrupt or exception handler is running.
+  static bool in_interrupt();
+
+private:
+  // Nesting depth of do_handle_interrupt.
+  static volatile uint32_t interrupt_depth;
+
 };
 } // namespace interrupts
 } // namespace uqaabOS
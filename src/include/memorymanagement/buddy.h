@@ -0,0 +1,87 @@
+#ifndef __MEMORYMANAGEMENT_BUDDY_H
+#define __MEMORYMANAGEMENT_BUDDY_H
+
+#include <stdint.h>
+
+#include "types.h"
+
+namespace uqaabOS {
+namespace memorymanagement {
+
+// Smallest block is 2^BUDDY_MIN_ORDER bytes (32 B).
+#define BUDDY_MIN_ORDER 5
+// Largest block is 2^BUDDY_MAX_ORDER bytes (1 GiB).
+#define BUDDY_MAX_ORDER 30
+
+// Block state kept in the side table, one byte per minimum-size block
+#define BUDDY_BLOCK_FREE 0x80      // Head of a free block
+#define BUDDY_BLOCK_ALLOCATED 0x40 // Head of an allocated block
+#define BUDDY_ORDER_MASK 0x1F      // Order of the block
+
+/**
+ * BuddyBlock: Links stored at the start of a free block.
+ */
+struct BuddyBlock {
+  BuddyBlock *next;
+  BuddyBlock *prev;
+};
+
+/**
+ * BuddyAllocator: Binary buddy allocator over one memory region.
+ * Every block has a power-of-two size and is aligned to its own size, so a
+ * block's buddy is found by flipping one address bit. Splitting and merging
+ * therefore walk at most one step per order (O(log n)).
+ * Block state lives in a side table at the start of the region instead of
+ * in block headers, so allocated blocks carry no header and stay naturally
+ * aligned. Rounding to a power of two bounds internal fragmentation below
+ * 50% of every block.
+ */
+class BuddyAllocator {
+private:
+  size_t arena_start;   // First byte managed as blocks
+  size_t arena_end;     // One past the last managed byte
+  uint8_t *block_table; // Side table, one entry per minimum-size block
+
+  BuddyBlock *free_lists[BUDDY_MAX_ORDER + 1]; // Free blocks per order
+  uint32_t free_counts[BUDDY_MAX_ORDER + 1];   // Length of each free list
+  uint32_t nonempty_orders;                    // Bit k set: free_lists[k] != 0
+
+  uint8_t *table_entry(size_t block);
+  void push_free(size_t block, int order);
+  void remove_free(size_t block, int order);
+
+public:
+  BuddyAllocator();
+
+  // Takes over [start, start + size) for block allocation.
+  void initialize(size_t start, size_t size);
+
+  // Smallest order whose block holds 'size' bytes, -1 if too large.
+  static int order_for_size(size_t size);
+
+  // Allocates a block of at least 'size' bytes aligned to 'alignment'.
+  void *malloc(size_t size, size_t alignment = 1);
+
+  // Frees a block returned by malloc.
+  void free(void *ptr);
+
+  // Size of the allocated block at 'ptr' (0 if not an allocated block).
+  size_t block_size(void *ptr);
+
+  // Total bytes held on the free lists.
+  size_t free_bytes();
+
+  // Number of free blocks of the given order.
+  uint32_t free_block_count(int order);
+
+  // Size of the largest free block (0 if none).
+  size_t largest_free_block();
+
+  // Prints the free blocks per order.
+  void print_statistics();
+};
+
+} // namespace memorymanagement
+} // namespace uqaabOS
+
+#endif
@@ -4,11 +4,28 @@
 #include <cstddef>
 #include <stdint.h>
 
+#include "buddy.h"
+#include "types.h"
+
 namespace uqaabOS {
 namespace memorymanagement {
 
-// @brief Typedef for storing size values of memory chunks.
-typedef unsigned long size_t;
+// Number of small-block size classes kept on segregated free lists.
+#define MEMORY_SIZE_CLASSES 8
+// Size of the smallest class in bytes; class i holds blocks of
+// (MEMORY_MIN_CLASS_SIZE << i) bytes, so the largest class is 2 KiB.
+#define MEMORY_MIN_CLASS_SIZE 16
+// Number of blocks carved from the chunk list when a size class runs dry.
+#define MEMORY_CLASS_REFILL_COUNT 8
+
+/**
+ * AllocationStrategy: Selects how MemoryManager satisfies requests.
+ * FIRST_FIT:      Walk the address-ordered chunk list (original behaviour).
+ * SEGREGATED_FIT: Serve small requests from per-size-class free lists in
+ *                 constant time and fall back to first-fit for large blocks.
+ * BUDDY:          Binary buddy allocator with O(log n) split and merge.
+ */
+enum AllocationStrategy { FIRST_FIT, SEGREGATED_FIT, BUDDY };
 
 /**
  * MemoryChunk: Represents a chunk of memory in the memory manager.
@@ -24,6 +41,31 @@ struct MemoryChunk {
   size_t size;
 };
 
+/**
+ * FreeBlock: Link stored in the payload of a chunk parked on a size-class
+ * free list. The chunk itself stays marked allocated in the chunk list so
+ * that coalescing never merges it while it is cached.
+ */
+struct FreeBlock {
+  FreeBlock *next;
+};
+
+/**
+ * MemoryStatistics: Counters maintained by malloc/free.
+ * Byte counts are in usable (payload) bytes, so a block parked on a size
+ * class or rounded up by the buddy allocator counts at its full size.
+ * searches/search_steps count chunk-list walks and the chunks visited.
+ */
+struct MemoryStatistics {
+  uint32_t allocations;
+  uint32_t frees;
+  uint32_t failed_allocations;
+  size_t bytes_in_use;
+  size_t peak_bytes_in_use;
+  uint32_t searches;
+  uint32_t search_steps;
+};
+
 /**
  * MemoryManager: Manages memory allocation and deallocation.
  * The MemoryManager class provides methods for allocating and freeing memory.
@@ -35,24 +77,91 @@ protected:
   // Pointer to the first memory chunk.
   MemoryChunk *first;
 
+  // Strategy used by malloc/free.
+  AllocationStrategy strategy;
+
+  // Heads of the per-size-class free lists (SEGREGATED_FIT only).
+  FreeBlock *size_classes[MEMORY_SIZE_CLASSES];
+
+  // Backend used by the BUDDY strategy.
+  BuddyAllocator buddy;
+
+  // Size of the managed pool in bytes.
+  size_t pool_size;
+
+  // Runtime counters, see MemoryStatistics.
+  MemoryStatistics stats;
+
+  // Returns the size class able to hold 'size' bytes, or -1 if too large.
+  static int size_class_index(size_t size);
+
+  // First-fit search of the chunk list for a free chunk of at least 'size'.
+  MemoryChunk *find_free_chunk(size_t size);
+
+  // Marks 'chunk' allocated, splitting off any usable remainder.
+  void *claim_chunk(MemoryChunk *chunk, size_t size);
+
+  // Returns a chunk to the chunk list, coalescing with free neighbours.
+  void release_chunk(MemoryChunk *chunk);
+
+  // Carves a batch of blocks for size class 'index' out of the chunk list.
+  bool refill_size_class(int index);
+
+  // Gives every cached size-class block back to the chunk list.
+  void reclaim_size_classes();
+
+  // Strategy-specific allocation, without statistics.
+  void *allocate(size_t size);
+  void *allocate_aligned(size_t size, size_t alignment);
+
+  // Usable size of the allocated block at 'ptr'.
+  size_t usable_size(void *ptr);
+
+  // Updates the counters after an allocation attempt.
+  void record_allocation(void *ptr);
+
 public:
   // Static pointer to the currently active memory manager.
   static MemoryManager *active_memory_manager;
 
   /**
    * Constructs a MemoryManager object.
-   * first: The starting address of the memory to manage.
-   * size:  The size of the memory to manage.
+   * first:    The starting address of the memory to manage.
+   * size:     The size of the memory to manage.
+   * strategy: The allocation strategy to use.
    */
-  MemoryManager(size_t first, size_t size);
+  MemoryManager(size_t first, size_t size,
+                AllocationStrategy strategy = FIRST_FIT);
 
   ~MemoryManager();
 
   // Allocates a block of memory, of size 'size'.
   void *malloc(size_t size);
 
+  // Allocates a block of 'size' bytes whose address is a multiple of
+  // 'alignment' (a power of two). The block is released with free().
+  void *malloc_aligned(size_t size, size_t alignment);
+
   // Frees a previously allocated block of memory.
   void free(void *ptr);
+
+  // Strategy selected at construction.
+  AllocationStrategy allocation_strategy();
+
+  // Prints the buddy allocator's free blocks per order.
+  void print_buddy_statistics();
+
+  // Allocation counters maintained by malloc/free.
+  const MemoryStatistics &statistics();
+
+  // Size of the largest block that can currently be handed out in one piece.
+  size_t largest_free_block();
+
+  // Total free bytes, including blocks cached on size-class lists.
+  size_t free_bytes();
+
+  // Prints the counters and a fragmentation report.
+  void print_statistics();
 };
 
 } // namespace memorymanagement
@@ -0,0 +1,79 @@
+#ifndef __MEMORYMANAGEMENT_PAGEFRAME_H
+#define __MEMORYMANAGEMENT_PAGEFRAME_H
+
+#include <stdint.h>
+
+#include "../multiboot.h"
+#include "memorymanagement.h"
+
+namespace uqaabOS {
+namespace memorymanagement {
+
+// Size of one physical page frame.
+#define PAGE_SIZE 4096
+// Frames needed to cover the 32-bit physical address space (4 GiB).
+#define PAGE_FRAME_MAX_FRAMES (1024 * 1024)
+// Frames below this address (BIOS data, VGA memory, ROMs) are never used.
+#define PAGE_FRAME_LOW_MEMORY_END 0x100000
+
+/**
+ * PageFrameAllocator: Hands out 4 KiB physical page frames.
+ * Free frames are tracked in a bitmap (bit set = frame free) with three
+ * summary levels on top of it, where each summary bit says whether the
+ * 32 bits below it contain any free frame. A free frame is found with one
+ * bit scan per level, so allocation and free are O(log32 n).
+ * The frame map is built from the multiboot memory map; reserved regions,
+ * memory below 1 MiB and the kernel image are never handed out.
+ */
+class PageFrameAllocator {
+private:
+  uint32_t total_frames;     // Frames that were usable at boot
+  uint32_t available_frames;  // Frames currently free
+  uint32_t end_frame;        // One past the highest usable frame
+
+  void mark_free(uint32_t frame);
+  void mark_used(uint32_t frame);
+  bool is_free(uint32_t frame);
+
+  // Marks every whole frame inside [start, end) as free
+  void add_region(uint64_t start, uint64_t end);
+
+public:
+  // Static pointer to the currently active frame allocator.
+  static PageFrameAllocator *active_page_frame_allocator;
+
+  /**
+   * Builds the frame map from the multiboot information structure.
+   * multiboot_info: Structure passed to kernel_main by the bootloader.
+   */
+  PageFrameAllocator(const include::MultibootInfo *multiboot_info);
+  ~PageFrameAllocator();
+
+  // Allocates one frame, returns its physical address or 0 if none is free.
+  void *allocate_frame();
+
+  // Returns a frame obtained from allocate_frame/allocate_frames.
+  void free_frame(void *frame);
+
+  // Allocates 'count' physically contiguous frames. This scans the bitmap
+  // and is meant for boot-time or rare large allocations.
+  void *allocate_frames(uint32_t count);
+
+  // Returns 'count' contiguous frames starting at 'frame'.
+  void free_frames(void *frame, uint32_t count);
+
+  // Marks every frame touching [start, start + length) as used.
+  void reserve_range(size_t start, size_t length);
+
+  uint32_t total_frame_count();
+  uint32_t free_frame_count();
+
+  // One past the highest frame reported as RAM; physical memory ends at
+  // end_frame_number() * PAGE_SIZE.
+  uint32_t end_frame_number();
+};
+
+} // namespace memorymanagement
+} // namespace uqaabOS
+
+#endif
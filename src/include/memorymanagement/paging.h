@@ -0,0 +1,127 @@
+#ifndef __MEMORYMANAGEMENT_PAGING_H
+#define __MEMORYMANAGEMENT_PAGING_H
+
+#include <stdint.h>
+
+#include "../interrupts.h"
+#include "pageframe.h"
+
+namespace uqaabOS {
+namespace memorymanagement {
+
+// Page directory / page table entry flags.
+#define PAGE_PRESENT 0x001
+#define PAGE_WRITABLE 0x002
+#define PAGE_USER 0x004
+#define PAGE_WRITE_THROUGH 0x008
+#define PAGE_CACHE_DISABLE 0x010
+#define PAGE_ACCESSED 0x020
+#define PAGE_DIRTY 0x040
+#define PAGE_LARGE 0x080 // Directory entry maps a 4 MiB page (PSE)
+#define PAGE_GLOBAL 0x100 // Not flushed from the TLB on CR3 reload (PGE)
+#define PAGE_FRAME_MASK 0xFFFFF000
+
+// Entries in a page directory or page table.
+#define PAGE_ENTRIES 1024
+// Size of a large page, i.e. the range covered by one directory entry.
+#define LARGE_PAGE_SIZE 0x400000
+
+// Page fault error code bits.
+#define PAGE_FAULT_PRESENT 0x1 // Protection violation (0 = page not present)
+#define PAGE_FAULT_WRITE 0x2
+#define PAGE_FAULT_USER 0x4
+
+/**
+ * PageDirectory / PageTable: One page of 1024 32-bit entries. Both always
+ * live in identity-mapped frames, so their physical address can be used
+ * directly as a pointer.
+ */
+struct PageDirectory {
+  uint32_t entries[PAGE_ENTRIES];
+} __attribute__((aligned(PAGE_SIZE)));
+
+struct PageTable {
+  uint32_t entries[PAGE_ENTRIES];
+} __attribute__((aligned(PAGE_SIZE)));
+
+/**
+ * PagingManager: Owns the kernel page directory and address spaces.
+ * All physical memory is identity-mapped in every address space, with
+ * global 4 MiB pages when the CPU supports PSE, so the kernel image, the
+ * heap and frame-allocator memory are reached through a handful of TLB
+ * entries that survive address space switches. Address spaces made with
+ * create_address_space share the kernel entries and can add 4 KiB
+ * mappings of their own above the identity-mapped range.
+ */
+class PagingManager {
+private:
+  PageFrameAllocator *frame_allocator;
+  PageDirectory *kernel_directory;
+  PageDirectory *current_directory;
+  uint32_t kernel_entries;  // Directory entries used by the identity map
+  bool large_pages;         // CPU supports 4 MiB pages (PSE)
+  bool global_pages;        // CPU supports global pages (PGE)
+
+  // Page table for 'virtual_address', allocated if 'create' is set.
+  PageTable *get_table(PageDirectory *directory, uint32_t virtual_address,
+                       bool create);
+
+public:
+  // Static pointer to the currently active paging manager.
+  static PagingManager *active_paging_manager;
+
+  /**
+   * Builds the kernel page directory.
+   * frame_allocator: Source of page table frames; its memory end sets the
+   *                  size of the identity map.
+   */
+  PagingManager(PageFrameAllocator *frame_allocator);
+  ~PagingManager();
+
+  // Loads the kernel directory and turns paging on.
+  void activate();
+
+  // Maps one 4 KiB page. Fails if the range is covered by a large page.
+  bool map_page(PageDirectory *directory, uint32_t virtual_address,
+                uint32_t physical_address, uint32_t flags);
+
+  // Maps one 4 MiB page (both addresses 4 MiB aligned).
+  bool map_large_page(PageDirectory *directory, uint32_t virtual_address,
+                      uint32_t physical_address, uint32_t flags);
+
+  // Removes a 4 KiB mapping and flushes it from the TLB if needed.
+  void unmap_page(PageDirectory *directory, uint32_t virtual_address);
+
+  // Physical address mapped at 'virtual_address', 0 if unmapped.
+  uint32_t translate(PageDirectory *directory, uint32_t virtual_address);
+
+  // New address space sharing the kernel mappings, 0 if out of frames.
+  PageDirectory *create_address_space();
+
+  // Frees a directory from create_address_space and its private tables.
+  void destroy_address_space(PageDirectory *directory);
+
+  // Loads 'directory' (0 = kernel directory) unless it is already active.
+  void switch_directory(PageDirectory *directory);
+
+  PageDirectory *kernel_page_directory();
+  PageDirectory *current_page_directory();
+};
+
+/**
+ * PageFaultHandler: Reports page faults (exception 0x0E) with the faulting
+ * address from CR2 and the decoded error code. There is no demand paging
+ * yet, so the fault is fatal and the CPU is halted.
+ */
+class PageFaultHandler : public interrupts::InterruptHandler {
+public:
+  PageFaultHandler(interrupts::InterruptManager *interrupt_manager);
+  ~PageFaultHandler();
+
+  virtual uint32_t handle_interrupt(uint32_t esp);
+};
+
+} // namespace memorymanagement
+} // namespace uqaabOS
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef __MEMORYMANAGEMENT_SLAB_H
+#define __MEMORYMANAGEMENT_SLAB_H
+
+#include <stdint.h>
+
+#include "memorymanagement.h"
+
+namespace uqaabOS {
+namespace memorymanagement {
+
+// Objects handed out by a cache are aligned to at least one cache line.
+#define SLAB_CACHE_LINE_SIZE 64
+// Smallest slab carved from the heap, in bytes.
+#define SLAB_MIN_SIZE 4096
+// A slab is grown until it holds at least this many objects.
+#define SLAB_MIN_OBJECTS 4
+// Number of completely free slabs a cache keeps instead of freeing them.
+#define SLAB_MAX_EMPTY_SLABS 1
+
+class KmemCache;
+
+/**
+ * SlabObject: Link stored inside a free object on a slab's free list.
+ */
+struct SlabObject {
+  SlabObject *next;
+};
+
+/**
+ * Slab: Header at the start of every slab.
+ * Slabs are allocated aligned to their own size, so the slab owning an
+ * object is found by masking the object address.
+ */
+struct Slab {
+  Slab *next;              // Next slab on the same partial/full/empty list
+  Slab *prev;              // Previous slab on the same list
+  KmemCache *cache;        // Cache this slab belongs to
+  SlabObject *free_list;   // Free objects inside this slab
+  uint32_t in_use;         // Number of allocated objects
+};
+
+/**
+ * KmemCache: Object cache for fixed-size kernel objects.
+ * Each cache owns slabs taken from the MemoryManager and keeps them on
+ * three lists: partial (some objects free), full (none free) and empty
+ * (all free). Allocation and free are constant time, and churning objects
+ * only moves them between a slab's free list and its callers, so the
+ * general heap is not fragmented.
+ */
+class KmemCache {
+  friend KmemCache *kmem_cache_create(const char *name, size_t size,
+                                      size_t align);
+  friend void kmem_cache_destroy(KmemCache *cache);
+  friend void kmem_cache_print_statistics();
+
+private:
+  const char *name;           // Name shown in statistics
+  size_t object_size;         // Size requested by the creator
+  size_t stride;              // Distance between objects inside a slab
+  size_t slab_size;           // Size (and alignment) of a slab
+  size_t first_object;        // Offset of the first object in a slab
+  uint32_t objects_per_slab;  // Objects carved from one slab
+
+  Slab *slabs_partial;
+  Slab *slabs_full;
+  Slab *slabs_empty;
+  uint32_t empty_count;
+
+  // Statistics
+  uint32_t slab_count;        // Slabs currently owned
+  uint32_t active_objects;    // Objects currently allocated
+  uint32_t total_allocs;      // Successful allocations since creation
+  uint32_t total_frees;       // Frees since creation
+  uint32_t failed_allocs;     // Allocations that found no memory
+
+  // Link in the global list of caches
+  KmemCache *next_cache;
+
+  KmemCache(const char *name, size_t size, size_t align);
+
+  Slab *grow();
+  void release_slab(Slab *slab);
+
+  static void list_remove(Slab **list, Slab *slab);
+  static void list_push(Slab **list, Slab *slab);
+
+public:
+  // Allocates one object, or returns 0 if the heap is exhausted.
+  void *alloc();
+
+  // Returns an object obtained from alloc() on this cache.
+  void free(void *ptr);
+
+  // Releases all completely free slabs back to the heap.
+  void shrink();
+
+  // Prints this cache's statistics on one line.
+  void print_statistics();
+
+  // Size of the objects handed out by this cache.
+  size_t size();
+};
+
+// Creates a cache of objects of 'size' bytes aligned to at least 'align'
+// (rounded up to SLAB_CACHE_LINE_SIZE).
+KmemCache *kmem_cache_create(const char *name, size_t size, size_t align);
+
+// Allocates an object from 'cache'.
+void *kmem_cache_alloc(KmemCache *cache);
+
+// Returns an object to 'cache'.
+void kmem_cache_free(KmemCache *cache, void *ptr);
+
+// Frees every slab of 'cache' and the cache itself.
+void kmem_cache_destroy(KmemCache *cache);
+
+// Prints statistics for every cache.
+void kmem_cache_print_statistics();
+
+} // namespace memorymanagement
+} // namespace uqaabOS
+
+#endif
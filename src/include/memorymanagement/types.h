@@ -0,0 +1,13 @@
+#ifndef __MEMORYMANAGEMENT_TYPES_H
+#define __MEMORYMANAGEMENT_TYPES_H
+
+namespace uqaabOS {
+namespace memorymanagement {
+
+// @brief Typedef for storing size values of memory chunks.
+typedef unsigned long size_t;
+
+} // namespace memorymanagement
+} // namespace uqaabOS
+
+#endif // __MEMORYMANAGEMENT_TYPES_H
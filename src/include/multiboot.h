@@ -0,0 +1,52 @@
+#ifndef __MULTIBOOT_H
+#define __MULTIBOOT_H
+
+#include <stdint.h>
+
+namespace uqaabOS {
+namespace include {
+
+// MultibootInfo::flags bits
+#define MULTIBOOT_INFO_MEMORY 0x00000001  // mem_lower/mem_upper are valid
+#define MULTIBOOT_INFO_MEM_MAP 0x00000040 // mmap_length/mmap_addr are valid
+
+// MultibootMemoryMapEntry::type value for RAM usable by the OS
+#define MULTIBOOT_MEMORY_AVAILABLE 1
+
+/*  **** Multiboot Information Structure ****
+   Handed to kernel_main by the bootloader. Only the fields up to the memory
+   map are described here; the rest of the structure is not used.
+   -> flags: which of the following fields are valid
+   -> mem_lower/mem_upper: KiB of memory below 1 MiB / above 1 MiB
+   -> mmap_length/mmap_addr: size and address of the memory map buffer
+   */
+struct MultibootInfo {
+  uint32_t flags;
+  uint32_t mem_lower;
+  uint32_t mem_upper;
+  uint32_t boot_device;
+  uint32_t cmdline;
+  uint32_t mods_count;
+  uint32_t mods_addr;
+  uint32_t syms[4];
+  uint32_t mmap_length;
+  uint32_t mmap_addr;
+} __attribute__((packed));
+
+/*  **** Memory Map Entry ****
+   -> size: size of the entry, not counting this field itself
+   -> base_addr: physical start of the region
+   -> length: length of the region in bytes
+   -> type: 1 for available RAM, anything else is reserved
+   */
+struct MultibootMemoryMapEntry {
+  uint32_t size;
+  uint64_t base_addr;
+  uint64_t length;
+  uint32_t type;
+} __attribute__((packed));
+
+} // namespace include
+} // namespace uqaabOS
+
+#endif
@@ -5,8 +5,27 @@
 
 #include "../gdt.h"
 
+// Timer ticks a task runs before it is preempted, unless set per task.
+#define TASK_DEFAULT_QUANTUM 2
+// Number of priority levels; 0 is the highest priority.
+#define TASK_PRIORITY_LEVELS 32
+#define TASK_DEFAULT_PRIORITY 16
+#define TASK_LOWEST_PRIORITY (TASK_PRIORITY_LEVELS - 1)
+// Stack size used unless another one is requested. One-page stacks come
+// from the page frame allocator, other sizes from the heap.
+#define TASK_DEFAULT_STACK_SIZE 4096
+#define TASK_MIN_STACK_SIZE 1024
+// Software interrupt a task raises to give up the CPU (the IRQ0x31 stub,
+// i.e. 0x31 + IRQ_BASE in interruptstub.asm).
+#define TASK_YIELD_INTERRUPT 0x51
+
 namespace uqaabOS
 {
+    namespace memorymanagement
+    {
+        struct PageDirectory;
+    }
+
     namespace multitasking
     {
         
@@ -33,32 +52,212 @@ namespace uqaabOS
         } __attribute__((packed));
 
 
+        /*
+         -> TASK_READY: on its priority's run queue
+         -> TASK_RUNNING: currently on the CPU (not on any queue)
+         -> TASK_BLOCKED: waiting for an event, on no run queue
+         -> TASK_SLEEPING: waiting for a timeout, on no run queue
+         -> TASK_EXITED: finished, waiting to be reaped or joined
+        */
+        enum TaskState { TASK_READY, TASK_RUNNING, TASK_BLOCKED, TASK_SLEEPING,
+                         TASK_EXITED };
+
+        class Task;
+
+        // Clears IF and returns the previous EFLAGS for restore_interrupts.
+        static inline uint32_t disable_interrupts() {
+            uint32_t flags;
+            asm volatile("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+            return flags;
+        }
+
+        static inline void restore_interrupts(uint32_t flags) {
+            if (flags & 0x200) // IF
+                asm volatile("sti" : : : "memory");
+        }
+
+        /*
+         -> FIFO of tasks blocked in TaskManager::sleep_on until the next
+            wake_up. Check the awaited condition with interrupts disabled
+            and call sleep_on in a loop, so a wakeup from an interrupt
+            handler cannot slip in between the check and the sleep.
+        */
+        struct WaitQueue{
+            Task* head;
+            Task* tail;
+            WaitQueue() : head(0), tail(0) {}
+        };
+
         class Task{
             friend class TaskManager;
             private:
-            uint8_t stack[4096];
+            uint8_t* stack;
+            uint32_t stack_size;
+            bool stack_from_frames;
             CPUState* cpu_state;
+            // Address space loaded while the task runs, 0 = kernel directory
+            memorymanagement::PageDirectory* page_directory;
+            bool owns_page_directory; // Destroyed with the stack on reaping
+            // Timer ticks per time slice, and ticks left in the current one
+            uint32_t quantum;
+            uint32_t ticks_left;
+
+            TaskState state;
+            uint8_t priority;
+            // Links in the run queue of 'priority' while TASK_READY
+            Task* next;
+            Task* prev;
+
+            int exit_code;
+            bool detached;        // Reaped on exit instead of by join()
+            bool from_task_cache; // Created by TaskManager::spawn
+            Task* joiner;         // Task blocked in join() on this one
+
+            Task* wait_next;      // Link in a WaitQueue while TASK_BLOCKED
+            WaitQueue* waiting_on; // Queue the task is blocked on, if any
+            Task* sleep_next;     // Link in the sleep list
+            uint64_t wake_tick;   // Tick at which to wake, 0 = not sleeping
+            bool wait_timed_out;  // Last sleep_on_timeout expired
+
+            void release_stack();
+            void release_page_directory();
 
             public:
-            Task(include::GDT* gdt , void (*entry_point)());
+            /*
+             -> entry_point: function the task starts in; returning from it
+                exits the task with code 0
+             -> argument: passed as the entry point's first argument
+            */
+            Task(include::GDT* gdt , void (*entry_point)(),
+                 memorymanagement::PageDirectory* page_directory = 0,
+                 uint32_t stack_size = TASK_DEFAULT_STACK_SIZE,
+                 void* argument = 0);
             ~Task();
+
+            // False if the stack could not be allocated.
+            bool is_valid();
+            void set_quantum(uint32_t ticks);
+            TaskState get_state();
+            uint8_t get_priority();
         };
 
         class TaskManager{
 
             private:
 
-            Task* tasks[256];
+            // One FIFO per priority; bit p of ready_bitmap is set while
+            // run_queue_head[p] is non-empty
+            Task* run_queue_head[TASK_PRIORITY_LEVELS];
+            Task* run_queue_tail[TASK_PRIORITY_LEVELS];
+            uint32_t ready_bitmap;
+
             int num_tasks;
-            int current_task;
+            // Running task, 0 while the boot (idle) context runs
+            Task* current_task;
+            // Exited tasks whose stacks have not been released yet
+            Task* zombies;
+            include::GDT* gdt;
+
+            // Sleeping tasks, sorted by wake_tick
+            Task* sleepers;
+            uint64_t ticks;
+            uint32_t tick_frequency;
+            // A task that should preempt the running one became ready
+            bool reschedule_pending;
+            // Saved state of the boot context, resumed when nothing is ready
+            CPUState* idle_cpu_state;
+
+            void enqueue(Task* task);
+            void dequeue(Task* task);
+            void add_sleeper(Task* task, uint64_t wake_tick);
+            void remove_sleeper(Task* task);
+            static void remove_waiter(WaitQueue* queue, Task* task);
+
+            // Context switch statistics, in TSC cycles spent in schedule()
+            uint32_t switch_count;
+            uint32_t last_switch_cycles;
+            uint32_t average_switch_cycles; // moving average over ~8 switches
+            uint32_t max_switch_cycles;
 
             public:
+            static TaskManager* active_task_manager;
 
-            TaskManager();
+            TaskManager(include::GDT* gdt = 0);
             ~TaskManager();
             bool add_task(Task* task);
+
+            /*
+             -> Creates and starts a task running entry_point(argument).
+             -> detached: reap the task on exit; otherwise it must be join()ed
+             -> page_directory: address space from create_address_space, 0 =
+                kernel directory; the task owns it once spawn succeeds
+             -> returns the task, or 0 if no memory is available
+            */
+            Task* spawn(void (*entry_point)(void*), void* argument = 0,
+                        uint32_t stack_size = TASK_DEFAULT_STACK_SIZE,
+                        uint8_t priority = TASK_DEFAULT_PRIORITY,
+                        bool detached = false,
+                        memorymanagement::PageDirectory* page_directory = 0);
+
+            // Ends the running task; never returns.
+            void exit(int exit_code);
+
+            // Waits for a spawned, non-detached task to exit, frees it and
+            // returns its exit code.
+            int join(Task* task);
+
+            // Gives up the CPU (task context only).
+            void yield();
+
+            // Releases the stacks of exited tasks, and frees detached ones.
+            void reap();
             CPUState* schedule(CPUState* cpu_state);
 
+            Task* get_current_task();
+
+            // Moves a blocked or sleeping task back to its run queue.
+            void make_ready(Task* task);
+
+            // Blocks the running task on 'queue' until wake_up(queue). In the
+            // idle context this halts until the next interrupt, and in
+            // interrupt context it returns at once; callers re-check their
+            // condition either way.
+            void sleep_on(WaitQueue* queue);
+
+            // Makes every task waiting on 'queue' ready (safe in interrupt
+            // handlers).
+            void wake_up(WaitQueue* queue);
+
+            // sleep_on that also ends after 'ticks' timer ticks. Returns
+            // false if the timeout expired before a wake_up.
+            bool sleep_on_timeout(WaitQueue* queue, uint32_t ticks);
+
+            // Blocks the running task for at least the given time.
+            void sleep_ticks(uint32_t ticks);
+            void sleep(uint32_t milliseconds);
+
+            // Rate at which tick() is called, set by the timer driver.
+            void set_tick_frequency(uint32_t frequency);
+            uint64_t get_ticks();
+            // Ticks covering at least 'milliseconds' (0 without a timer).
+            uint32_t milliseconds_to_ticks(uint32_t milliseconds);
+
+            // True when an interrupt handler made a task ready that should
+            // run before the interrupted one.
+            bool needs_reschedule();
+
+            // Marks 'task' blocked or sleeping and takes it off the run
+            // queue; the running task keeps the CPU until the next schedule().
+            void block(Task* task, TaskState state);
+
+            void set_priority(Task* task, uint8_t priority);
+
+            // Charges one timer tick to the running task; true when its
+            // quantum is used up and schedule() should run.
+            bool tick();
+
+            void print_statistics();
+
         };
     } // namespace multitasking
     
@@ -72,6 +72,11 @@ namespace uqaabOS
             virtual uint16_t read();
             virtual void write(uint16_t);
 
+            // Bulk transfer of 'words' 16-bit values with a single
+            // rep insw / rep outsw, e.g. a 256-word ATA sector.
+            void read_block(uint16_t* buffer, uint32_t words);
+            void write_block(const uint16_t* buffer, uint32_t words);
+
             protected:
 
             static inline uint16_t read16(uint16_t port){
@@ -86,6 +91,14 @@ namespace uqaabOS
                 __asm__ volatile("outw %0, %1" : : "a" (data), "Nd" (port));
             }
 
+            static inline void read16_block(uint16_t port , uint16_t* buffer , uint32_t words){
+                __asm__ volatile("cld; rep insw" : "+D" (buffer), "+c" (words) : "d" (port) : "memory");
+            }
+
+            static inline void write16_block(uint16_t port , const uint16_t* buffer , uint32_t words){
+                __asm__ volatile("cld; rep outsw" : "+S" (buffer), "+c" (words) : "d" (port) : "memory");
+            }
+
         };
 
         //32 bit port
@@ -1,21 +1,32 @@
 #ifndef __TERMINAL_H
 #define __TERMINAL_H
 
+#include "../drivers/pit.h"
+#include "../drivers/storage/buffercache.h"
 #include "../filesystem/fat32.h"
 #include "../libc/stdio.h"
 #include "../libc/string.h"
+#include "../memorymanagement/slab.h"
 
 namespace uqaabOS {
 namespace terminal {
 
 #define TERMINAL_BUFFER_SIZE 256
 #define MAX_ARGS 32
+// Keys buffered between the keyboard interrupt and the terminal task.
+#define TERMINAL_KEY_BUFFER_SIZE 64
 
 class Terminal {
 private:
     filesystem::FAT32* fat32;
     char input_buffer[TERMINAL_BUFFER_SIZE];
     int buffer_position;
+
+    // Ring buffer filled by queue_key() in IRQ1 and drained by run()
+    char key_buffer[TERMINAL_KEY_BUFFER_SIZE];
+    volatile int key_head;
+    volatile int key_count;
+    multitasking::WaitQueue key_queue;
     
     // Command handlers
     void handle_ls(int argc, char* argv[]);
@@ -26,6 +37,13 @@ private:
     void handle_cat(int argc, char* argv[]);
     void handle_write(int argc, char* argv[]);
     void handle_echo(int argc, char* argv[]);
+    void handle_df();
+    void handle_sync();
+    void handle_slabinfo();
+    void handle_buddyinfo();
+    void handle_cacheinfo();
+    void handle_meminfo();
+    void handle_sched();
     void handle_help();
     void handle_clear();
     
@@ -37,8 +55,14 @@ private:
 public:
     Terminal(filesystem::FAT32* fat32_instance);
     void initialize();
+    // Reads keys and runs commands forever; meant to run as its own task so
+    // that commands execute outside the keyboard interrupt.
     void run();
     void handle_key_press(char c);
+    // Called from the keyboard interrupt: buffers 'c' and wakes run().
+    void queue_key(char c);
+    // Blocks until a key is available.
+    char read_key();
 };
 
 } // namespace terminal
@@ -3,14 +3,20 @@
 #include "include/drivers/keyboard.h"
 #include "include/drivers/mouse.h"
 #include "include/drivers/pci.h"
+#include "include/drivers/pit.h"
 // #include "include/drivers/vga.h"
 #include "include/drivers/storage/ata.h"
+#include "include/drivers/storage/blockqueue.h"
+#include "include/drivers/storage/buffercache.h"
 #include "include/filesystem/fat32.h"
 #include "include/filesystem/msdospart.h"
 #include "include/gdt.h"
 #include "include/interrupts.h"
 #include "include/libc/stdio.h"
 #include "include/memorymanagement/memorymanagement.h"
+#include "include/memorymanagement/pageframe.h"
+#include "include/memorymanagement/paging.h"
+#include "include/multiboot.h"
 #include "include/multitasking/multitasking.h"
 #include "include/terminal/terminal.h"
 #include "include/terminal/terminal_keyboard.h"
@@ -23,6 +29,11 @@
 #error "This code must be compiled with an x86-elf compiler"
 #endif
 
+// Kernel heap backend: FIRST_FIT, SEGREGATED_FIT or BUDDY
+#ifndef KERNEL_HEAP_STRATEGY
+#define KERNEL_HEAP_STRATEGY uqaabOS::memorymanagement::SEGREGATED_FIT
+#endif
+
 using namespace uqaabOS::terminal;
 
 class MouseToConsole : public uqaabOS::driver::MouseEventHandler {
@@ -63,24 +74,29 @@ public:
   }
 };
 
-void taskA() {
-  for (int i = 0; i < 100; i++) {
-    uqaabOS::libc::printf("A");
-    // Yield every 10 iterations
-    if (i % 10 == 9) {
-      asm volatile("int $0x20");
-    }
-  }
+// Terminal task: the terminal is interactive, so it outranks default tasks
+#define TERMINAL_TASK_STACK_SIZE (16 * 1024)
+#define TERMINAL_TASK_PRIORITY (TASK_DEFAULT_PRIORITY - 4)
+
+static void terminal_task(void *terminal) {
+  ((uqaabOS::terminal::Terminal *)terminal)->run();
 }
 
-void taskB() {
-  for (int i = 0; i < 100; i++) {
-    uqaabOS::libc::printf("B");
-    // Yield every 10 iterations
-    if (i % 10 == 9) {
-      asm volatile("int $0x20");
-    }
-  }
+// Block I/O task: dispatches queued disk requests. It outranks the tasks
+// that submit them, so a request is picked up as soon as it is queued.
+#define BLOCK_IO_TASK_STACK_SIZE (8 * 1024)
+#define BLOCK_IO_TASK_PRIORITY (TASK_DEFAULT_PRIORITY - 8)
+
+static void block_io_task(void *queue) {
+  ((uqaabOS::driver::BlockRequestQueue *)queue)->run();
+}
+
+// Cache flusher task: writes dirty cached blocks back every few seconds.
+#define CACHE_FLUSH_TASK_STACK_SIZE (4 * 1024)
+#define CACHE_FLUSH_TASK_PRIORITY (TASK_DEFAULT_PRIORITY - 2)
+
+static void cache_flush_task(void *cache) {
+  ((uqaabOS::driver::BufferCache *)cache)->run_flusher();
 }
 
 // Kernel entry point
@@ -94,18 +110,33 @@ extern "C" void kernel_main(const void *multiboot_structure,
   uqaabOS::include::GDT gdt;
   uqaabOS::libc::printf("Loaded GDT....\n");
 
+  // Initialize the physical page frame allocator from the multiboot memory map
+  uqaabOS::libc::printf("Initializing PageFrameAllocator...\n");
+  uqaabOS::memorymanagement::PageFrameAllocator frame_allocator(
+      (const uqaabOS::include::MultibootInfo *)multiboot_structure);
+  uqaabOS::libc::printf("Free page frames: ");
+  uqaabOS::libc::print_int(frame_allocator.free_frame_count());
+  uqaabOS::libc::printf("\n");
+
   // Initialize MemoryManager
+  // The heap takes half of the free frames; the rest stays available for
+  // page-sized users (task stacks, disk buffers)
   uqaabOS::libc::printf("Initializing MemoryManager...\n");
-  uint32_t *memupper =
-      (uint32_t *)(((uqaabOS::memorymanagement::size_t)multiboot_structure) +
-                   8);
-  size_t heap = 10 * 1024 * 1024;
+  uint32_t heap_frames = frame_allocator.free_frame_count() / 2;
+  size_t heap = 0;
+  while (heap_frames > 0 && heap == 0) {
+    heap = (size_t)frame_allocator.allocate_frames(heap_frames);
+    if (heap == 0)
+      heap_frames /= 2; // No run that long, try a smaller heap
+  }
   uqaabOS::memorymanagement::MemoryManager memoryManager(
-      heap, (*memupper) * 1024 - heap - 10 * 1024);
+      heap, heap_frames * PAGE_SIZE, KERNEL_HEAP_STRATEGY);
   uqaabOS::libc::printf("MemoryManager initialized.\n");
 
   uqaabOS::libc::printf("heap: ");
   uqaabOS::libc::print_hex(heap);
+  uqaabOS::libc::printf(" size: ");
+  uqaabOS::libc::print_hex(heap_frames * PAGE_SIZE);
 
   void *allocated = memoryManager.malloc(1024);
   uqaabOS::libc::printf("\nallocated: ");
@@ -114,18 +145,29 @@ extern "C" void kernel_main(const void *multiboot_structure,
 
   // Initialize TaskManager
   uqaabOS::libc::printf("Initializing TaskManager...\n");
-  uqaabOS::multitasking::TaskManager task_manager;
+  uqaabOS::multitasking::TaskManager task_manager(&gdt);
   uqaabOS::libc::printf("TaskManager initialized.\n");
 
-  // For now, we're not adding any tasks to avoid freezing the system
-  // In a real implementation, we would need to properly manage task memory
+  // Tasks are started with task_manager.spawn(); returning from the entry
+  // point exits the task, and its stack is reclaimed by the idle loop
 
   // Initialize InterruptManager with TaskManager
   uqaabOS::interrupts::InterruptManager interrupt_manager(0x20, &gdt,
                                                           &task_manager);
 
+  // Turn on paging: all RAM identity-mapped with large pages where possible
+  uqaabOS::memorymanagement::PageFaultHandler page_fault_handler(
+      &interrupt_manager);
+  uqaabOS::memorymanagement::PagingManager paging_manager(&frame_allocator);
+  paging_manager.activate();
+
   uqaabOS::driver::DriverManager driver_manager;
 
+  // Timer: programs the PIT and preempts tasks every quantum
+  uqaabOS::driver::PITDriver timer(&interrupt_manager, &task_manager,
+                                   PIT_DEFAULT_FREQUENCY);
+  driver_manager.add_driver(&timer);
+
   MouseToConsole mouse_event_driver;
   uqaabOS::driver::MouseDriver mouse(&interrupt_manager, &mouse_event_driver);
   driver_manager.add_driver(&mouse);
@@ -150,18 +192,39 @@ extern "C" void kernel_main(const void *multiboot_structure,
   uqaabOS::driver::ATA ata0m(&interrupt_manager, true, 0x1F0);
   ata0m.identify();
 
+  // Bus-master DMA through BAR4 of the PCI IDE controller, if there is one
+  uint16_t bus_master_base = 0;
+  uqaabOS::driver::PeripheralComponentInterconnectDeviceDescriptor ide_controller;
+  if (pci_controller.find_device(0x01, 0x01, &ide_controller)) {
+    uqaabOS::driver::BaseAdressRegister bar4 = pci_controller.get_base_adress_register(
+        ide_controller.bus, ide_controller.device, ide_controller.function, 4);
+    if (bar4.type == uqaabOS::driver::input_output)
+      bus_master_base = (uint32_t)bar4.address;
+  }
+  uqaabOS::driver::IDEBusMaster ata0_dma(bus_master_base, 0);
+  if (bus_master_base != 0) {
+    pci_controller.enable_bus_mastering(&ide_controller);
+    if (ata0m.attach_dma(&ata0_dma))
+      uqaabOS::libc::printf("ATA primary master: bus-master DMA enabled\n");
+  }
+
+  // Elevator-ordered request queue in front of the drive
+  uqaabOS::driver::BlockRequestQueue ata0_queue(&ata0m);
+  // Buffer cache on top of the queue; everything above reads through it
+  uqaabOS::driver::BufferCache ata0_cache(&ata0_queue);
+
   // uqaabOS::libc::printf("\n ATA primary slave: ");
   // uqaabOS::driver::ATA ata0s(false, 0x1F0);
   // ata0s.identify();
 
   // Read partitions
-  uqaabOS::filesystem::MSDOSPartitionTable::read_partitions(&ata0m);
+  uqaabOS::filesystem::MSDOSPartitionTable::read_partitions(&ata0_cache);
   uqaabOS::libc::printf("\n");
 
   // Test our new FAT32 implementation
   uint32_t fat32_lba =
       uqaabOS::filesystem::MSDOSPartitionTable::get_first_fat32_partition_lba(
-          &ata0m);
+          &ata0_cache);
   if (fat32_lba == 0) {
     uqaabOS::libc::printf("No FAT32 partition found or invalid MBR\n");
   } else {
@@ -169,20 +232,38 @@ extern "C" void kernel_main(const void *multiboot_structure,
     uqaabOS::libc::print_hex(fat32_lba);
     uqaabOS::libc::printf("\n");
 
-    uqaabOS::filesystem::FAT32 fat32(&ata0m, fat32_lba);
+    uqaabOS::filesystem::FAT32 fat32(&ata0_cache, fat32_lba);
     if (fat32.initialize()) {
       uqaabOS::libc::printf("FAT32 filesystem initialized successfully\n");
       
       // Initialize terminal with FAT32 instance
-      // We'll create the terminal on the stack and run it in a loop
       uqaabOS::terminal::Terminal terminal(&fat32);
       keyboard_event_handler.set_terminal(&terminal);
       terminal.initialize();
-      
-      // Keep the terminal alive by entering a loop
-      // In a real implementation, you might want to structure this differently
+
+      // From here on disk requests are dispatched in the background
+      if (task_manager.spawn(block_io_task, &ata0_queue, BLOCK_IO_TASK_STACK_SIZE,
+                             BLOCK_IO_TASK_PRIORITY, true) == 0)
+        uqaabOS::libc::printf("Failed to start the block I/O task\n");
+
+      // Writes are only held back in the cache while something flushes them
+      if (task_manager.spawn(cache_flush_task, &ata0_cache,
+                             CACHE_FLUSH_TASK_STACK_SIZE,
+                             CACHE_FLUSH_TASK_PRIORITY, true) != 0)
+        ata0_cache.set_write_back(true);
+      else
+        uqaabOS::libc::printf("Failed to start the cache flusher task\n");
+
+      // Commands run in the terminal task; the keyboard interrupt only
+      // queues keys and wakes it
+      if (task_manager.spawn(terminal_task, &terminal, TERMINAL_TASK_STACK_SIZE,
+                             TERMINAL_TASK_PRIORITY, true) == 0)
+        uqaabOS::libc::printf("Failed to start the terminal task\n");
+
+      // This loop is the idle context: it runs whenever no task is ready
       while (1) {
-        // The terminal will handle input through the keyboard interrupt handler
+        // Free what exited tasks left behind
+        task_manager.reap();
         asm volatile("hlt"); // Halt CPU until next interrupt
       }
     } else {
@@ -0,0 +1,201 @@
+#include "../include/memorymanagement/buddy.h"
+#include "../include/libc/stdio.h"
+
+namespace uqaabOS {
+namespace memorymanagement {
+/*
+ * Buddy Allocation Approach:
+ * - The region is covered by free blocks whose size is a power of two and
+ *   whose address is a multiple of that size.
+ * - malloc rounds the request up to the next order, takes the smallest
+ *   non-empty free list of at least that order (found with one bit scan)
+ *   and splits the block in halves until it has the right order.
+ * - free looks up the block's order in the side table and merges it with
+ *   its buddy (address XOR block size) for as long as the buddy is a free
+ *   block of the same order.
+ */
+
+BuddyAllocator::BuddyAllocator() {
+  arena_start = 0;
+  arena_end = 0;
+  block_table = 0;
+  nonempty_orders = 0;
+  for (int i = 0; i <= BUDDY_MAX_ORDER; i++) {
+    free_lists[i] = 0;
+    free_counts[i] = 0;
+  }
+}
+
+/* Region Setup
+ * @param start: Start of the memory region
+ * @param size: Size of the memory region */
+void BuddyAllocator::initialize(size_t start, size_t size) {
+  const size_t min_block = (size_t)1 << BUDDY_MIN_ORDER;
+
+  // The side table sits at the front of the region
+  size_t table_size = (size >> BUDDY_MIN_ORDER) + 1;
+  block_table = (uint8_t *)start;
+  arena_start = (start + table_size + min_block - 1) & ~(min_block - 1);
+  arena_end = (start + size) & ~(min_block - 1);
+  if (arena_end <= arena_start) {
+    arena_start = arena_end = 0;
+    return;
+  }
+
+  for (size_t i = 0; i < table_size; i++)
+    block_table[i] = 0;
+
+  // Cover the arena with the largest naturally aligned blocks that fit
+  size_t block = arena_start;
+  while (block + min_block <= arena_end) {
+    int order = BUDDY_MIN_ORDER;
+    while (order < BUDDY_MAX_ORDER &&
+           (block & (((size_t)1 << (order + 1)) - 1)) == 0 &&
+           block + ((size_t)1 << (order + 1)) <= arena_end)
+      order++;
+    push_free(block, order);
+    block += (size_t)1 << order;
+  }
+}
+
+uint8_t *BuddyAllocator::table_entry(size_t block) {
+  return &block_table[(block - arena_start) >> BUDDY_MIN_ORDER];
+}
+
+void BuddyAllocator::push_free(size_t block, int order) {
+  BuddyBlock *entry = (BuddyBlock *)block;
+  entry->prev = 0;
+  entry->next = free_lists[order];
+  if (entry->next != 0)
+    entry->next->prev = entry;
+  free_lists[order] = entry;
+  free_counts[order]++;
+  nonempty_orders |= 1u << order;
+  *table_entry(block) = BUDDY_BLOCK_FREE | order;
+}
+
+void BuddyAllocator::remove_free(size_t block, int order) {
+  BuddyBlock *entry = (BuddyBlock *)block;
+  if (entry->prev != 0)
+    entry->prev->next = entry->next;
+  else
+    free_lists[order] = entry->next;
+  if (entry->next != 0)
+    entry->next->prev = entry->prev;
+  free_counts[order]--;
+  if (free_lists[order] == 0)
+    nonempty_orders &= ~(1u << order);
+  *table_entry(block) = 0;
+}
+
+int BuddyAllocator::order_for_size(size_t size) {
+  int order = BUDDY_MIN_ORDER;
+  while (order <= BUDDY_MAX_ORDER && ((size_t)1 << order) < size)
+    order++;
+  return order > BUDDY_MAX_ORDER ? -1 : order;
+}
+
+/* Block Allocation
+ * @param size: Requested size
+ * @param alignment: Required alignment (power of two)
+ * @return: Block address or 0 if no block is large enough */
+void *BuddyAllocator::malloc(size_t size, size_t alignment) {
+  // Blocks are aligned to their size, so alignment is just a minimum size
+  int order = order_for_size(size > alignment ? size : alignment);
+  if (order < 0)
+    return 0;
+
+  // Smallest non-empty list at or above the wanted order
+  uint32_t candidates = nonempty_orders & ~((1u << order) - 1);
+  if (candidates == 0)
+    return 0;
+  int current = __builtin_ctz(candidates);
+
+  size_t block = (size_t)free_lists[current];
+  remove_free(block, current);
+
+  // Split, keeping the lower half and freeing the upper one
+  while (current > order) {
+    current--;
+    push_free(block + ((size_t)1 << current), current);
+  }
+
+  *table_entry(block) = BUDDY_BLOCK_ALLOCATED | order;
+  return (void *)block;
+}
+
+/* Block Free
+ * @param ptr: Block returned by malloc */
+void BuddyAllocator::free(void *ptr) {
+  size_t block = (size_t)ptr;
+  if (block < arena_start || block >= arena_end ||
+      !(*table_entry(block) & BUDDY_BLOCK_ALLOCATED)) {
+    libc::printf("BuddyAllocator: invalid free ");
+    libc::print_hex(block);
+    libc::printf("\n");
+    return;
+  }
+
+  int order = *table_entry(block) & BUDDY_ORDER_MASK;
+  *table_entry(block) = 0;
+
+  // Merge with the buddy while it is a free block of the same order
+  while (order < BUDDY_MAX_ORDER) {
+    size_t buddy = block ^ ((size_t)1 << order);
+    if (buddy < arena_start || buddy + ((size_t)1 << order) > arena_end)
+      break;
+    if (*table_entry(buddy) != (BUDDY_BLOCK_FREE | order))
+      break;
+    remove_free(buddy, order);
+    if (buddy < block)
+      block = buddy;
+    order++;
+  }
+
+  push_free(block, order);
+}
+
+size_t BuddyAllocator::block_size(void *ptr) {
+  size_t block = (size_t)ptr;
+  if (block < arena_start || block >= arena_end ||
+      !(*table_entry(block) & BUDDY_BLOCK_ALLOCATED))
+    return 0;
+  return (size_t)1 << (*table_entry(block) & BUDDY_ORDER_MASK);
+}
+
+size_t BuddyAllocator::free_bytes() {
+  size_t total = 0;
+  for (int order = BUDDY_MIN_ORDER; order <= BUDDY_MAX_ORDER; order++)
+    total += (size_t)free_counts[order] << order;
+  return total;
+}
+
+uint32_t BuddyAllocator::free_block_count(int order) {
+  if (order < 0 || order > BUDDY_MAX_ORDER)
+    return 0;
+  return free_counts[order];
+}
+
+size_t BuddyAllocator::largest_free_block() {
+  if (nonempty_orders == 0)
+    return 0;
+  return (size_t)1 << (31 - __builtin_clz(nonempty_orders));
+}
+
+void BuddyAllocator::print_statistics() {
+  libc::printf("Free blocks per order:\n");
+  for (int order = BUDDY_MIN_ORDER; order <= BUDDY_MAX_ORDER; order++) {
+    if (free_counts[order] == 0)
+      continue;
+    libc::printf("  order ");
+    libc::print_int(order);
+    libc::printf(" (");
+    libc::print_hex((size_t)1 << order);
+    libc::printf(" bytes): ");
+    libc::print_int(free_counts[order]);
+    libc::printf("\n");
+  }
+}
+
+} // namespace memorymanagement
+} // namespace uqaabOS
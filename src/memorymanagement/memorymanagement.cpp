@@ -1,4 +1,5 @@
-#include "../include/memorymanagement/memorymanagement.h" 
+#include "../include/memorymanagement/memorymanagement.h"
+#include "../include/libc/stdio.h"
 
 namespace uqaabOS {
 namespace memorymanagement {
@@ -9,6 +10,12 @@ namespace memorymanagement {
  * - First-fit allocation strategy: Scans from the first chunk to find the first sufficiently large free block.
  * - Splitting: When allocating, if remaining space is enough for another chunk, split into allocated chunk and new free chunk.
  * - Coalescing: When freeing memory, merge with adjacent free chunks to prevent fragmentation.
+ * - Segregated fit (optional): Small requests are rounded up to a power-of-two size class and
+ *   served from a per-class free list in constant time. Blocks on these lists stay marked
+ *   allocated in the chunk list, so only large blocks take part in coalescing.
+ * - Buddy (optional): The whole pool is handed to a BuddyAllocator instead of the chunk list.
+ * - Statistics: malloc/free keep running counters (MemoryStatistics); the walk-based
+ *   figures (largest free block, free bytes) are computed only when asked for.
  * - Operators new/delete are overridden to use the active MemoryManager instance.
 */
 
@@ -19,9 +26,32 @@ MemoryManager *MemoryManager::active_memory_manager = 0;
 /* MemoryManager Constructor
  * Initializes memory manager with initial memory block
  * @param start: Starting address of the memory pool
- * @param size: Total size of the memory pool */
-MemoryManager::MemoryManager(size_t start, size_t size) {
+ * @param size: Total size of the memory pool
+ * @param strategy: Allocation strategy used by malloc/free */
+MemoryManager::MemoryManager(size_t start, size_t size,
+                             AllocationStrategy strategy) {
   active_memory_manager = this;  // Set this instance as active
+  this->strategy = strategy;
+  pool_size = size;
+
+  stats.allocations = 0;
+  stats.frees = 0;
+  stats.failed_allocations = 0;
+  stats.bytes_in_use = 0;
+  stats.peak_bytes_in_use = 0;
+  stats.searches = 0;
+  stats.search_steps = 0;
+
+  // All size-class free lists start out empty
+  for (int i = 0; i < MEMORY_SIZE_CLASSES; i++)
+    size_classes[i] = 0;
+
+  // The buddy backend manages the pool itself
+  if (strategy == BUDDY) {
+    first = 0;
+    buddy.initialize(start, size);
+    return;
+  }
 
   // Check if initial size is too small for even one MemoryChunk
   if (size < sizeof(MemoryChunk)) {
@@ -46,23 +76,39 @@ MemoryManager::~MemoryManager() {
     active_memory_manager = 0;
 }
 
-/* Memory Allocation Function
+/* Size Class Lookup
  * @param size: Requested memory size
- * @return: Pointer to allocated memory or 0 if failed */
-void *MemoryManager::malloc(size_t size) {
-  MemoryChunk *result = 0;
+ * @return: Index of the smallest class holding 'size' bytes, -1 if too large */
+int MemoryManager::size_class_index(size_t size) {
+  size_t class_size = MEMORY_MIN_CLASS_SIZE;
+  for (int i = 0; i < MEMORY_SIZE_CLASSES; i++) {
+    if (size <= class_size)
+      return i;
+    class_size <<= 1;
+  }
+  return -1;
+}
 
-  // First-fit search: Iterate through chunks until suitable free chunk found
-  for (MemoryChunk *chunk = first; chunk != 0 && result == 0;
-       chunk = chunk->next) {
+/* First-Fit Search
+ * @param size: Requested memory size
+ * @return: First free chunk larger than 'size' or 0 if none */
+MemoryChunk *MemoryManager::find_free_chunk(size_t size) {
+  stats.searches++;
+  // Iterate through chunks until suitable free chunk found
+  for (MemoryChunk *chunk = first; chunk != 0; chunk = chunk->next) {
+    stats.search_steps++;
     // Check if chunk is free and has sufficient size
     if (chunk->size > size && !chunk->allocated)
-      result = chunk;
+      return chunk;
   }
+  return 0;
+}
 
-  if (result == 0)  // No suitable chunk found
-    return 0;
-
+/* Chunk Claiming
+ * @param result: Free chunk returned by find_free_chunk
+ * @param size: Requested memory size
+ * @return: Pointer to the usable memory area of the chunk */
+void *MemoryManager::claim_chunk(MemoryChunk *result, size_t size) {
   /* Split chunk if remaining space is enough for a new chunk (metadata + at least 1 byte)
    * This prevents creating chunks with zero usable space */
   if (result->size >= size + sizeof(MemoryChunk) + 1) {
@@ -88,11 +134,9 @@ void *MemoryManager::malloc(size_t size) {
   return (void *)(((size_t)result) + sizeof(MemoryChunk));
 }
 
-/* Memory Deallocation Function
- * @param ptr: Pointer to memory to be freed */
-void MemoryManager::free(void *ptr) {
-  // Get chunk metadata from memory pointer (subtract metadata size)
-  MemoryChunk *chunk = (MemoryChunk *)((size_t)ptr - sizeof(MemoryChunk));
+/* Chunk Release
+ * @param chunk: Allocated chunk to hand back to the chunk list */
+void MemoryManager::release_chunk(MemoryChunk *chunk) {
   chunk->allocated = false;  // Mark as free
 
   // Coalesce with previous chunk if it's free
@@ -115,6 +159,305 @@ void MemoryManager::free(void *ptr) {
   }
 }
 
+/* Size Class Refill
+ * Carves up to MEMORY_CLASS_REFILL_COUNT adjacent blocks out of one free
+ * chunk, so only one list walk is paid per batch of small allocations.
+ * @param index: Size class to refill
+ * @return: true if at least one block was added */
+bool MemoryManager::refill_size_class(int index) {
+  size_t class_size = MEMORY_MIN_CLASS_SIZE << index;
+  // Only blocks of exactly the class size may live on the class list, so a
+  // chunk must fit the class exactly or leave a splittable remainder
+  size_t split_size = class_size + sizeof(MemoryChunk) + 1;
+
+  // First fit, passing over chunks that are too small to split
+  stats.searches++;
+  MemoryChunk *chunk = first;
+  for (; chunk != 0; chunk = chunk->next) {
+    stats.search_steps++;
+    if (!chunk->allocated &&
+        (chunk->size == class_size || chunk->size >= split_size))
+      break;
+  }
+
+  // Each split leaves the remainder as the next free chunk, so keep carving
+  // from it while it can still provide an exact block
+  int carved = 0;
+  while (chunk != 0 && !chunk->allocated &&
+         (chunk->size == class_size || chunk->size >= split_size) &&
+         carved < MEMORY_CLASS_REFILL_COUNT) {
+    FreeBlock *block = (FreeBlock *)claim_chunk(chunk, class_size);
+    block->next = size_classes[index];
+    size_classes[index] = block;
+    carved++;
+
+    chunk = chunk->next;
+  }
+
+  return carved > 0;
+}
+
+/* Size Class Reclaim
+ * Slow path taken when a large request fails: every cached small block is
+ * released (and coalesced) so the space becomes usable for large blocks. */
+void MemoryManager::reclaim_size_classes() {
+  for (int i = 0; i < MEMORY_SIZE_CLASSES; i++) {
+    while (size_classes[i] != 0) {
+      FreeBlock *block = size_classes[i];
+      size_classes[i] = block->next;
+      release_chunk((MemoryChunk *)((size_t)block - sizeof(MemoryChunk)));
+    }
+  }
+}
+
+/* Memory Allocation Function
+ * @param size: Requested memory size
+ * @return: Pointer to allocated memory or 0 if failed */
+void *MemoryManager::malloc(size_t size) {
+  void *ptr = allocate(size);
+  record_allocation(ptr);
+  return ptr;
+}
+
+/* Aligned Memory Allocation Function
+ * @param size: Requested memory size
+ * @param alignment: Required alignment (power of two)
+ * @return: Aligned pointer to allocated memory or 0 if failed */
+void *MemoryManager::malloc_aligned(size_t size, size_t alignment) {
+  void *ptr = allocate_aligned(size, alignment);
+  record_allocation(ptr);
+  return ptr;
+}
+
+/* Strategy Dispatch
+ * @param size: Requested memory size
+ * @return: Pointer to allocated memory or 0 if failed */
+void *MemoryManager::allocate(size_t size) {
+  if (strategy == BUDDY)
+    return buddy.malloc(size);
+
+  if (strategy == SEGREGATED_FIT) {
+    int index = size_class_index(size);
+    if (index >= 0) {
+      // Constant-time path: pop the head of the size-class list
+      if (size_classes[index] == 0 && !refill_size_class(index)) {
+        // Blocks cached in other classes may be pinning the space
+        reclaim_size_classes();
+        if (!refill_size_class(index))
+          return 0;
+      }
+      FreeBlock *block = size_classes[index];
+      size_classes[index] = block->next;
+      return (void *)block;
+    }
+  }
+
+  MemoryChunk *result = find_free_chunk(size);
+
+  if (result == 0 && strategy == SEGREGATED_FIT) {
+    // Cached small blocks may be pinning the space we need
+    reclaim_size_classes();
+    result = find_free_chunk(size);
+  }
+
+  if (result == 0)  // No suitable chunk found
+    return 0;
+
+  return claim_chunk(result, size);
+}
+
+/* Aligned Allocation
+ * Walks the chunk list for a free chunk that can hold 'size' bytes at an
+ * aligned address. The slack in front of the aligned payload is left behind
+ * as a free chunk of its own, so no memory is wasted on padding.
+ * @param size: Requested memory size
+ * @param alignment: Required alignment (power of two)
+ * @return: Aligned pointer to allocated memory or 0 if failed */
+void *MemoryManager::allocate_aligned(size_t size, size_t alignment) {
+  if (strategy == BUDDY)
+    return buddy.malloc(size, alignment);
+
+  if (alignment <= sizeof(size_t))
+    return allocate(size);
+
+  for (int attempt = 0; attempt < 2; attempt++) {
+    stats.searches++;
+    for (MemoryChunk *chunk = first; chunk != 0; chunk = chunk->next) {
+      stats.search_steps++;
+      if (chunk->allocated)
+        continue;
+
+      size_t payload = (size_t)chunk + sizeof(MemoryChunk);
+      size_t aligned = (payload + alignment - 1) & ~(alignment - 1);
+
+      // The leading remainder must be able to hold its own chunk header
+      while (aligned != payload && aligned - payload < sizeof(MemoryChunk) + 1)
+        aligned += alignment;
+
+      if (aligned + size > payload + chunk->size)
+        continue;
+
+      if (aligned == payload)
+        return claim_chunk(chunk, size);
+
+      // Split off the leading remainder as a free chunk
+      MemoryChunk *temp = (MemoryChunk *)(aligned - sizeof(MemoryChunk));
+      temp->allocated = false;
+      temp->size = payload + chunk->size - aligned;
+      temp->prev = chunk;
+      temp->next = chunk->next;
+      if (temp->next != 0)
+        temp->next->prev = temp;
+
+      chunk->size = (size_t)temp - payload;
+      chunk->next = temp;
+
+      return claim_chunk(temp, size);
+    }
+
+    // Cached small blocks may be pinning the space we need
+    if (strategy != SEGREGATED_FIT)
+      break;
+    reclaim_size_classes();
+  }
+
+  return 0;
+}
+
+/* Memory Deallocation Function
+ * @param ptr: Pointer to memory to be freed */
+void MemoryManager::free(void *ptr) {
+  if (ptr == 0)
+    return;
+
+  stats.frees++;
+  stats.bytes_in_use -= usable_size(ptr);
+
+  if (strategy == BUDDY) {
+    buddy.free(ptr);
+    return;
+  }
+
+  // Get chunk metadata from memory pointer (subtract metadata size)
+  MemoryChunk *chunk = (MemoryChunk *)((size_t)ptr - sizeof(MemoryChunk));
+
+  if (strategy == SEGREGATED_FIT) {
+    // Chunks of exactly a class size are parked on that class's list
+    int index = size_class_index(chunk->size);
+    if (index >= 0 &&
+        chunk->size == ((size_t)MEMORY_MIN_CLASS_SIZE << index)) {
+      FreeBlock *block = (FreeBlock *)ptr;
+      block->next = size_classes[index];
+      size_classes[index] = block;
+      return;
+    }
+  }
+
+  release_chunk(chunk);
+}
+
+AllocationStrategy MemoryManager::allocation_strategy() { return strategy; }
+
+void MemoryManager::print_buddy_statistics() {
+  if (strategy != BUDDY) {
+    libc::printf("Heap is not using the buddy allocator\n");
+    return;
+  }
+  buddy.print_statistics();
+}
+
+/* Usable Block Size
+ * @param ptr: Pointer returned by malloc
+ * @return: Payload size of the block, as accounted in the statistics */
+size_t MemoryManager::usable_size(void *ptr) {
+  if (strategy == BUDDY)
+    return buddy.block_size(ptr);
+  return ((MemoryChunk *)((size_t)ptr - sizeof(MemoryChunk)))->size;
+}
+
+/* Allocation Accounting
+ * @param ptr: Result of an allocation attempt (0 on failure) */
+void MemoryManager::record_allocation(void *ptr) {
+  if (ptr == 0) {
+    stats.failed_allocations++;
+    return;
+  }
+  stats.allocations++;
+  stats.bytes_in_use += usable_size(ptr);
+  if (stats.bytes_in_use > stats.peak_bytes_in_use)
+    stats.peak_bytes_in_use = stats.bytes_in_use;
+}
+
+const MemoryStatistics &MemoryManager::statistics() { return stats; }
+
+/* Largest Free Block
+ * Walks the chunk list; blocks cached on size-class lists are not counted
+ * since they can only serve their own class.
+ * @return: Largest request that can be satisfied without reclaiming */
+size_t MemoryManager::largest_free_block() {
+  if (strategy == BUDDY)
+    return buddy.largest_free_block();
+
+  size_t largest = 0;
+  for (MemoryChunk *chunk = first; chunk != 0; chunk = chunk->next) {
+    if (!chunk->allocated && chunk->size > largest)
+      largest = chunk->size;
+  }
+  return largest;
+}
+
+/* Free Bytes
+ * @return: Free payload bytes in the chunk list plus cached size-class blocks */
+size_t MemoryManager::free_bytes() {
+  if (strategy == BUDDY)
+    return buddy.free_bytes();
+
+  size_t total = 0;
+  for (MemoryChunk *chunk = first; chunk != 0; chunk = chunk->next) {
+    if (!chunk->allocated)
+      total += chunk->size;
+  }
+  for (int i = 0; i < MEMORY_SIZE_CLASSES; i++) {
+    for (FreeBlock *block = size_classes[i]; block != 0; block = block->next)
+      total += (size_t)MEMORY_MIN_CLASS_SIZE << i;
+  }
+  return total;
+}
+
+/* Statistics Report
+ * Prints the counters together with a fragmentation figure, i.e. the share
+ * of free memory that lies outside the largest free block. */
+void MemoryManager::print_statistics() {
+  static const char *strategy_names[] = {"first-fit", "segregated-fit", "buddy"};
+  size_t free_total = free_bytes();
+  size_t largest = largest_free_block();
+
+  libc::printf("Heap strategy:   %s\n", strategy_names[strategy]);
+  libc::printf("Heap size:       %d KiB\n", (int)(pool_size / 1024));
+  libc::printf("Allocations:     %d\n", (int)stats.allocations);
+  libc::printf("Frees:           %d\n", (int)stats.frees);
+  libc::printf("Failed:          %d\n", (int)stats.failed_allocations);
+  libc::printf("In use:          %d bytes\n", (int)stats.bytes_in_use);
+  libc::printf("Peak in use:     %d bytes\n", (int)stats.peak_bytes_in_use);
+  libc::printf("Free:            %d bytes\n", (int)free_total);
+  libc::printf("Largest free:    %d bytes\n", (int)largest);
+
+  // 32-bit arithmetic only: the kernel is not linked against libgcc
+  if (free_total >= 100) {
+    size_t contiguous = largest / (free_total / 100);
+    if (contiguous > 100)
+      contiguous = 100;
+    libc::printf("Fragmentation:   %d%%\n", (int)(100 - contiguous));
+  }
+
+  if (stats.searches != 0) {
+    uint32_t tenths = stats.search_steps / stats.searches * 10 +
+                      stats.search_steps % stats.searches * 10 / stats.searches;
+    libc::printf("Avg list walk:   %d.%d chunks (%d searches)\n",
+                 (int)(tenths / 10), (int)(tenths % 10), (int)stats.searches);
+  }
+}
+
 } // namespace memorymanagement
 } // namespace uqaabOS
 
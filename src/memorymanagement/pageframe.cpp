@@ -0,0 +1,221 @@
+#include "../include/memorymanagement/pageframe.h"
+#include "../include/libc/stdio.h"
+
+// Bounds of the kernel image, provided by linker.ld
+extern "C" uint8_t kernel_start[];
+extern "C" uint8_t kernel_end[];
+
+namespace uqaabOS {
+namespace memorymanagement {
+/*
+ * Page Frame Allocation Approach:
+ * Physical memory is split into 4 KiB frames, one bit per frame in
+ * frame_bitmap (1 = free). Finding a free frame by scanning that bitmap
+ * would be linear in the amount of RAM, so three summary levels sit on top
+ * of it:
+ * - summary1 bit i is set when frame_bitmap word i has a free frame,
+ * - summary2 bit i is set when summary1 word i is non-zero,
+ * - summary3 bit i is set when summary2 word i is non-zero.
+ * Allocation follows the lowest set bit from summary3 down to the frame
+ * (four bit scans); free sets the bits back up the levels.
+ * The bitmaps live in .bss because global constructors are not run and the
+ * boot stack is far too small to hold them.
+ */
+
+static uint32_t frame_bitmap[PAGE_FRAME_MAX_FRAMES / 32];
+static uint32_t summary1[PAGE_FRAME_MAX_FRAMES / (32 * 32)];
+static uint32_t summary2[PAGE_FRAME_MAX_FRAMES / (32 * 32 * 32)];
+static uint32_t summary3;
+
+PageFrameAllocator *PageFrameAllocator::active_page_frame_allocator = 0;
+
+/* PageFrameAllocator Constructor
+ * @param multiboot_info: Multiboot information structure from the loader */
+PageFrameAllocator::PageFrameAllocator(
+    const include::MultibootInfo *multiboot_info) {
+  active_page_frame_allocator = this;
+  total_frames = 0;
+  available_frames = 0;
+  end_frame = 0;
+
+  // Start with every frame used, then free what the firmware reports as RAM
+  for (uint32_t i = 0; i < PAGE_FRAME_MAX_FRAMES / 32; i++)
+    frame_bitmap[i] = 0;
+  for (uint32_t i = 0; i < PAGE_FRAME_MAX_FRAMES / (32 * 32); i++)
+    summary1[i] = 0;
+  for (uint32_t i = 0; i < PAGE_FRAME_MAX_FRAMES / (32 * 32 * 32); i++)
+    summary2[i] = 0;
+  summary3 = 0;
+
+  if (multiboot_info->flags & MULTIBOOT_INFO_MEM_MAP) {
+    // Walk the memory map; each entry's size field excludes itself
+    size_t entry_address = multiboot_info->mmap_addr;
+    size_t mmap_end = multiboot_info->mmap_addr + multiboot_info->mmap_length;
+    while (entry_address < mmap_end) {
+      include::MultibootMemoryMapEntry *entry =
+          (include::MultibootMemoryMapEntry *)entry_address;
+      if (entry->type == MULTIBOOT_MEMORY_AVAILABLE)
+        add_region(entry->base_addr, entry->base_addr + entry->length);
+      entry_address += entry->size + sizeof(entry->size);
+    }
+  } else if (multiboot_info->flags & MULTIBOOT_INFO_MEMORY) {
+    // No memory map: everything mem_upper reports above 1 MiB is RAM
+    add_region(0x100000,
+               0x100000 + (uint64_t)multiboot_info->mem_upper * 1024);
+  }
+
+  // Never hand out the kernel image or the boot information
+  reserve_range((size_t)kernel_start, (size_t)kernel_end - (size_t)kernel_start);
+  reserve_range((size_t)multiboot_info, sizeof(include::MultibootInfo));
+  if (multiboot_info->flags & MULTIBOOT_INFO_MEM_MAP)
+    reserve_range(multiboot_info->mmap_addr, multiboot_info->mmap_length);
+
+  total_frames = available_frames;
+}
+
+PageFrameAllocator::~PageFrameAllocator() {
+  if (active_page_frame_allocator == this)
+    active_page_frame_allocator = 0;
+}
+
+void PageFrameAllocator::mark_free(uint32_t frame) {
+  if (is_free(frame))
+    return;
+  frame_bitmap[frame >> 5] |= 1u << (frame & 31);
+  summary1[frame >> 10] |= 1u << ((frame >> 5) & 31);
+  summary2[frame >> 15] |= 1u << ((frame >> 10) & 31);
+  summary3 |= 1u << (frame >> 15);
+  available_frames++;
+}
+
+void PageFrameAllocator::mark_used(uint32_t frame) {
+  if (!is_free(frame))
+    return;
+  available_frames--;
+
+  // Clear the summary bits only when the word below them became empty
+  frame_bitmap[frame >> 5] &= ~(1u << (frame & 31));
+  if (frame_bitmap[frame >> 5] != 0)
+    return;
+  summary1[frame >> 10] &= ~(1u << ((frame >> 5) & 31));
+  if (summary1[frame >> 10] != 0)
+    return;
+  summary2[frame >> 15] &= ~(1u << ((frame >> 10) & 31));
+  if (summary2[frame >> 15] != 0)
+    return;
+  summary3 &= ~(1u << (frame >> 15));
+}
+
+bool PageFrameAllocator::is_free(uint32_t frame) {
+  return frame_bitmap[frame >> 5] & (1u << (frame & 31));
+}
+
+/* Region Registration
+ * @param start: Physical start of an available region
+ * @param end: Physical end (exclusive) of the region */
+void PageFrameAllocator::add_region(uint64_t start, uint64_t end) {
+  // Skip low memory and anything beyond 4 GiB
+  if (start < PAGE_FRAME_LOW_MEMORY_END)
+    start = PAGE_FRAME_LOW_MEMORY_END;
+  if (end > (uint64_t)PAGE_FRAME_MAX_FRAMES * PAGE_SIZE)
+    end = (uint64_t)PAGE_FRAME_MAX_FRAMES * PAGE_SIZE;
+
+  // Only whole frames are usable
+  uint64_t first_frame = (start + PAGE_SIZE - 1) / PAGE_SIZE;
+  uint64_t last_frame = end / PAGE_SIZE;
+  for (uint64_t frame = first_frame; frame < last_frame; frame++)
+    mark_free((uint32_t)frame);
+  if (last_frame > first_frame && last_frame > end_frame)
+    end_frame = (uint32_t)last_frame;
+}
+
+void PageFrameAllocator::reserve_range(size_t start, size_t length) {
+  if (length == 0)
+    return;
+  uint64_t first_frame = start / PAGE_SIZE;
+  uint64_t last_frame = ((uint64_t)start + length + PAGE_SIZE - 1) / PAGE_SIZE;
+  if (last_frame > PAGE_FRAME_MAX_FRAMES)
+    last_frame = PAGE_FRAME_MAX_FRAMES;
+  for (uint64_t frame = first_frame; frame < last_frame; frame++)
+    mark_used((uint32_t)frame);
+}
+
+/* Frame Allocation
+ * @return: Physical address of a free frame or 0 if memory is exhausted */
+void *PageFrameAllocator::allocate_frame() {
+  if (summary3 == 0)
+    return 0;
+
+  // Follow the lowest set bit down each level
+  uint32_t index2 = __builtin_ctz(summary3);
+  uint32_t index1 = (index2 << 5) | __builtin_ctz(summary2[index2]);
+  uint32_t index0 = (index1 << 5) | __builtin_ctz(summary1[index1]);
+  uint32_t frame = (index0 << 5) | __builtin_ctz(frame_bitmap[index0]);
+
+  mark_used(frame);
+  return (void *)((size_t)frame * PAGE_SIZE);
+}
+
+/* Frame Free
+ * @param frame: Physical address returned by allocate_frame */
+void PageFrameAllocator::free_frame(void *frame) {
+  size_t address = (size_t)frame;
+  if (address % PAGE_SIZE != 0 || address < PAGE_FRAME_LOW_MEMORY_END) {
+    libc::printf("free_frame: invalid frame ");
+    libc::print_hex(address);
+    libc::printf("\n");
+    return;
+  }
+  mark_free(address / PAGE_SIZE);
+}
+
+/* Contiguous Frame Allocation
+ * Scans the bitmap for the first run of 'count' free frames. Whole
+ * bitmap words that are full are skipped.
+ * @param count: Number of frames
+ * @return: Physical address of the first frame or 0 if no run is found */
+void *PageFrameAllocator::allocate_frames(uint32_t count) {
+  if (count == 0 || count > available_frames)
+    return 0;
+  if (count == 1)
+    return allocate_frame();
+
+  uint32_t run_start = 0;
+  uint32_t run_length = 0;
+  for (uint32_t frame = 0; frame < PAGE_FRAME_MAX_FRAMES; frame++) {
+    // Skip words without any free frame
+    if ((frame & 31) == 0 && frame_bitmap[frame >> 5] == 0) {
+      run_length = 0;
+      frame += 31;
+      continue;
+    }
+
+    if (!is_free(frame)) {
+      run_length = 0;
+      continue;
+    }
+
+    if (run_length == 0)
+      run_start = frame;
+    if (++run_length == count) {
+      for (uint32_t i = 0; i < count; i++)
+        mark_used(run_start + i);
+      return (void *)((size_t)run_start * PAGE_SIZE);
+    }
+  }
+  return 0;
+}
+
+void PageFrameAllocator::free_frames(void *frame, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++)
+    free_frame((void *)((size_t)frame + i * PAGE_SIZE));
+}
+
+uint32_t PageFrameAllocator::total_frame_count() { return total_frames; }
+
+uint32_t PageFrameAllocator::free_frame_count() { return available_frames; }
+
+uint32_t PageFrameAllocator::end_frame_number() { return end_frame; }
+
+} // namespace memorymanagement
+} // namespace uqaabOS
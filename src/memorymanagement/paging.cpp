@@ -0,0 +1,306 @@
+#include "../include/memorymanagement/paging.h"
+#include "../include/libc/stdio.h"
+
+// End of the kernel image, provided by linker.ld
+extern "C" uint8_t kernel_end[];
+
+namespace uqaabOS {
+namespace memorymanagement {
+/*
+ * Paging Approach:
+ * - The kernel page directory identity-maps physical memory from 0 up to
+ *   the end of RAM reported by the frame allocator, so every pointer the
+ *   kernel already holds (heap, frames, VGA memory) stays valid once
+ *   paging is on.
+ * - With PSE each directory entry maps a 4 MiB page directly: the kernel
+ *   image, the heap and the frame pool need one TLB entry per 4 MiB and no
+ *   page tables at all. With PGE those entries are also global, so a CR3
+ *   reload on a task switch does not flush them. Without PSE the same
+ *   range is mapped through 4 KiB page tables taken from the frame
+ *   allocator.
+ * - An address space made by create_address_space copies the kernel
+ *   directory entries and owns everything above them; its page tables are
+ *   freed by destroy_address_space.
+ * - Page directories and tables are frames, and frames are identity-mapped,
+ *   so a table's physical address is also its virtual address.
+ */
+
+#define CPUID_FEATURE_PSE (1 << 3)
+#define CPUID_FEATURE_PGE (1 << 13)
+#define CR0_PAGING 0x80000000
+#define CR0_WRITE_PROTECT 0x00010000
+#define CR4_PSE 0x00000010
+#define CR4_PGE 0x00000080
+
+// The kernel directory lives in .bss: it is needed before any frame is
+// handed out and for as long as the kernel runs.
+static PageDirectory kernel_directory_storage;
+
+PagingManager *PagingManager::active_paging_manager = 0;
+
+static inline void invalidate_page(uint32_t virtual_address) {
+  asm volatile("invlpg (%0)" : : "r"(virtual_address) : "memory");
+}
+
+/* PagingManager Constructor
+ * Detects PSE/PGE and fills the kernel directory with the identity map.
+ * @param frame_allocator: Frame source for page tables and directories */
+PagingManager::PagingManager(PageFrameAllocator *frame_allocator) {
+  active_paging_manager = this;
+  this->frame_allocator = frame_allocator;
+  kernel_directory = &kernel_directory_storage;
+  current_directory = 0;
+
+  uint32_t eax = 1, ebx, ecx, edx;
+  asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+  large_pages = (edx & CPUID_FEATURE_PSE) != 0;
+  global_pages = (edx & CPUID_FEATURE_PGE) != 0;
+
+  // Cover all RAM and at least the kernel image
+  uint32_t end_frame = frame_allocator->end_frame_number();
+  uint32_t kernel_frames = ((uint32_t)kernel_end + PAGE_SIZE - 1) / PAGE_SIZE;
+  if (end_frame < kernel_frames)
+    end_frame = kernel_frames;
+  kernel_entries = (end_frame + PAGE_ENTRIES - 1) / PAGE_ENTRIES;
+  if (kernel_entries > PAGE_ENTRIES)
+    kernel_entries = PAGE_ENTRIES;
+
+  for (uint32_t i = 0; i < PAGE_ENTRIES; i++)
+    kernel_directory->entries[i] = 0;
+
+  uint32_t flags = PAGE_PRESENT | PAGE_WRITABLE;
+  if (global_pages)
+    flags |= PAGE_GLOBAL;
+
+  for (uint32_t i = 0; i < kernel_entries; i++) {
+    uint32_t base = i * LARGE_PAGE_SIZE;
+    if (large_pages) {
+      kernel_directory->entries[i] = base | flags | PAGE_LARGE;
+      continue;
+    }
+
+    PageTable *table = (PageTable *)frame_allocator->allocate_frame();
+    if (table == 0) {
+      libc::printf("Paging: out of frames for the identity map\n");
+      kernel_entries = i;
+      break;
+    }
+    for (uint32_t j = 0; j < PAGE_ENTRIES; j++)
+      table->entries[j] = (base + j * PAGE_SIZE) | flags;
+    kernel_directory->entries[i] = (uint32_t)table | PAGE_PRESENT | PAGE_WRITABLE;
+  }
+}
+
+PagingManager::~PagingManager() {
+  if (active_paging_manager == this)
+    active_paging_manager = 0;
+}
+
+/* Paging Activation
+ * Enables PSE/PGE as available, loads the kernel directory and sets
+ * CR0.PG (with CR0.WP so read-only pages are honoured in ring 0 too). */
+void PagingManager::activate() {
+  uint32_t cr4;
+  asm volatile("mov %%cr4, %0" : "=r"(cr4));
+  if (large_pages)
+    cr4 |= CR4_PSE;
+  if (global_pages)
+    cr4 |= CR4_PGE;
+  asm volatile("mov %0, %%cr4" : : "r"(cr4));
+
+  current_directory = kernel_directory;
+  asm volatile("mov %0, %%cr3" : : "r"(kernel_directory) : "memory");
+
+  uint32_t cr0;
+  asm volatile("mov %%cr0, %0" : "=r"(cr0));
+  cr0 |= CR0_PAGING | CR0_WRITE_PROTECT;
+  asm volatile("mov %0, %%cr0" : : "r"(cr0) : "memory");
+
+  libc::printf("Paging enabled: ");
+  libc::print_int(kernel_entries * (LARGE_PAGE_SIZE / 0x100000));
+  libc::printf(large_pages ? " MiB identity-mapped with 4 MiB pages\n"
+                           : " MiB identity-mapped with 4 KiB pages\n");
+}
+
+/* Page Table Lookup
+ * @param directory: Directory to search
+ * @param virtual_address: Address inside the wanted table's range
+ * @param create: Allocate and install the table if it is missing
+ * @return: Page table, or 0 if missing (or a large page covers the range) */
+PageTable *PagingManager::get_table(PageDirectory *directory,
+                                    uint32_t virtual_address, bool create) {
+  uint32_t &entry = directory->entries[virtual_address >> 22];
+  if (entry & PAGE_PRESENT) {
+    if (entry & PAGE_LARGE)
+      return 0;
+    return (PageTable *)(entry & PAGE_FRAME_MASK);
+  }
+  if (!create)
+    return 0;
+
+  PageTable *table = (PageTable *)frame_allocator->allocate_frame();
+  if (table == 0)
+    return 0;
+  for (uint32_t i = 0; i < PAGE_ENTRIES; i++)
+    table->entries[i] = 0;
+  entry = (uint32_t)table | PAGE_PRESENT | PAGE_WRITABLE | PAGE_USER;
+  return table;
+}
+
+/* Page Mapping
+ * @param directory: Address space to modify
+ * @param virtual_address: Page-aligned virtual address
+ * @param physical_address: Page-aligned physical address
+ * @param flags: PAGE_* flags (PAGE_PRESENT is implied)
+ * @return: true on success */
+bool PagingManager::map_page(PageDirectory *directory, uint32_t virtual_address,
+                             uint32_t physical_address, uint32_t flags) {
+  // Tables under the identity map are shared by every address space
+  if (directory != kernel_directory && (virtual_address >> 22) < kernel_entries)
+    return false;
+
+  PageTable *table = get_table(directory, virtual_address, true);
+  if (table == 0)
+    return false;
+
+  table->entries[(virtual_address >> 12) & (PAGE_ENTRIES - 1)] =
+      (physical_address & PAGE_FRAME_MASK) | (flags & 0xFFF) | PAGE_PRESENT;
+  if (directory == current_directory)
+    invalidate_page(virtual_address);
+  return true;
+}
+
+/* Large Page Mapping
+ * @param directory: Address space to modify
+ * @param virtual_address: 4 MiB aligned virtual address
+ * @param physical_address: 4 MiB aligned physical address
+ * @param flags: PAGE_* flags (PAGE_PRESENT and PAGE_LARGE are implied)
+ * @return: true on success, false without PSE or if the slot is in use */
+bool PagingManager::map_large_page(PageDirectory *directory,
+                                   uint32_t virtual_address,
+                                   uint32_t physical_address, uint32_t flags) {
+  if (!large_pages || (virtual_address | physical_address) % LARGE_PAGE_SIZE)
+    return false;
+  if (directory != kernel_directory && (virtual_address >> 22) < kernel_entries)
+    return false;
+
+  uint32_t &entry = directory->entries[virtual_address >> 22];
+  if ((entry & PAGE_PRESENT) && !(entry & PAGE_LARGE))
+    return false; // A page table is installed here
+
+  entry = physical_address | (flags & 0xFFF) | PAGE_PRESENT | PAGE_LARGE;
+  if (directory == current_directory)
+    invalidate_page(virtual_address);
+  return true;
+}
+
+void PagingManager::unmap_page(PageDirectory *directory,
+                               uint32_t virtual_address) {
+  PageTable *table = get_table(directory, virtual_address, false);
+  if (table == 0)
+    return;
+  table->entries[(virtual_address >> 12) & (PAGE_ENTRIES - 1)] = 0;
+  if (directory == current_directory || directory == kernel_directory)
+    invalidate_page(virtual_address);
+}
+
+uint32_t PagingManager::translate(PageDirectory *directory,
+                                  uint32_t virtual_address) {
+  uint32_t entry = directory->entries[virtual_address >> 22];
+  if (!(entry & PAGE_PRESENT))
+    return 0;
+  if (entry & PAGE_LARGE)
+    return (entry & ~(LARGE_PAGE_SIZE - 1)) |
+           (virtual_address & (LARGE_PAGE_SIZE - 1));
+
+  entry = ((PageTable *)(entry & PAGE_FRAME_MASK))
+              ->entries[(virtual_address >> 12) & (PAGE_ENTRIES - 1)];
+  if (!(entry & PAGE_PRESENT))
+    return 0;
+  return (entry & PAGE_FRAME_MASK) | (virtual_address & (PAGE_SIZE - 1));
+}
+
+/* Address Space Creation
+ * @return: Directory sharing the kernel entries, or 0 if out of frames */
+PageDirectory *PagingManager::create_address_space() {
+  PageDirectory *directory = (PageDirectory *)frame_allocator->allocate_frame();
+  if (directory == 0)
+    return 0;
+
+  for (uint32_t i = 0; i < kernel_entries; i++)
+    directory->entries[i] = kernel_directory->entries[i];
+  for (uint32_t i = kernel_entries; i < PAGE_ENTRIES; i++)
+    directory->entries[i] = 0;
+  return directory;
+}
+
+/* Address Space Destruction
+ * Frees the page tables above the kernel entries and the directory. Mapped
+ * frames belong to whoever mapped them and are not freed here.
+ * @param directory: Directory from create_address_space */
+void PagingManager::destroy_address_space(PageDirectory *directory) {
+  if (directory == 0 || directory == kernel_directory)
+    return;
+  if (directory == current_directory)
+    switch_directory(kernel_directory);
+
+  for (uint32_t i = kernel_entries; i < PAGE_ENTRIES; i++) {
+    uint32_t entry = directory->entries[i];
+    if ((entry & PAGE_PRESENT) && !(entry & PAGE_LARGE))
+      frame_allocator->free_frame((void *)(entry & PAGE_FRAME_MASK));
+  }
+  frame_allocator->free_frame(directory);
+}
+
+/* Address Space Switch
+ * Called by the scheduler on every switch; the CR3 write (and the TLB flush
+ * of non-global entries that comes with it) is skipped when both tasks use
+ * the same directory.
+ * @param directory: Directory to load, 0 for the kernel directory */
+void PagingManager::switch_directory(PageDirectory *directory) {
+  if (directory == 0)
+    directory = kernel_directory;
+  if (directory == current_directory || current_directory == 0)
+    return;
+  current_directory = directory;
+  asm volatile("mov %0, %%cr3" : : "r"(directory) : "memory");
+}
+
+PageDirectory *PagingManager::kernel_page_directory() {
+  return kernel_directory;
+}
+
+PageDirectory *PagingManager::current_page_directory() {
+  return current_directory;
+}
+
+PageFaultHandler::PageFaultHandler(
+    interrupts::InterruptManager *interrupt_manager)
+    : InterruptHandler(interrupt_manager, 0x0E) {}
+
+PageFaultHandler::~PageFaultHandler() {}
+
+/* Page Fault Handler
+ * @param esp: Stack pointer pointing at the saved CPUState
+ * @return: Does not return; the kernel is halted */
+uint32_t PageFaultHandler::handle_interrupt(uint32_t esp) {
+  multitasking::CPUState *cpu = (multitasking::CPUState *)esp;
+  uint32_t fault_address;
+  asm volatile("mov %%cr2, %0" : "=r"(fault_address));
+
+  libc::printf("PAGE FAULT at ");
+  libc::print_hex(fault_address);
+  libc::printf(" eip ");
+  libc::print_hex(cpu->eip);
+  libc::printf((cpu->error & PAGE_FAULT_PRESENT) ? " (protection" : " (not present");
+  libc::printf((cpu->error & PAGE_FAULT_WRITE) ? ", write" : ", read");
+  libc::printf((cpu->error & PAGE_FAULT_USER) ? ", user)\n" : ", kernel)\n");
+
+  // Returning would re-execute the faulting instruction forever
+  while (1)
+    asm volatile("cli; hlt");
+  return esp;
+}
+
+} // namespace memorymanagement
+} // namespace uqaabOS
@@ -0,0 +1,300 @@
+#include "../include/memorymanagement/slab.h"
+#include "../include/libc/stdio.h"
+
+namespace uqaabOS {
+namespace memorymanagement {
+/*
+ * Slab Allocator Approach:
+ * Frequently created objects of one size get their own KmemCache. A cache
+ * takes large, self-aligned slabs from the MemoryManager and cuts them into
+ * equally sized, cache-line aligned objects.
+ * - Every slab starts with a Slab header followed by its objects. Because a
+ *   slab is aligned to its own (power-of-two) size, the owning slab of any
+ *   object is found by masking the object address.
+ * - Free objects of a slab are chained through their first word.
+ * - Slabs move between the partial, full and empty lists as objects are
+ *   allocated and freed; allocation always prefers a partial slab.
+ * - Up to SLAB_MAX_EMPTY_SLABS empty slabs are kept per cache, so object
+ *   churn does not keep allocating and freeing slabs on the heap.
+ */
+
+// Global list of caches, used for statistics
+static KmemCache *cache_list = 0;
+
+/* KmemCache Constructor
+ * @param name: Name shown in statistics
+ * @param size: Size of each object
+ * @param align: Requested object alignment */
+KmemCache::KmemCache(const char *name, size_t size, size_t align) {
+  this->name = name;
+  this->object_size = size;
+
+  // Objects are at least cache-line aligned and can hold the free-list link
+  if (align < SLAB_CACHE_LINE_SIZE)
+    align = SLAB_CACHE_LINE_SIZE;
+  if (size < sizeof(SlabObject))
+    size = sizeof(SlabObject);
+  stride = (size + align - 1) & ~(align - 1);
+  first_object = (sizeof(Slab) + align - 1) & ~(align - 1);
+
+  // Grow the slab (in powers of two) until it holds enough objects
+  slab_size = SLAB_MIN_SIZE;
+  while (slab_size < first_object + stride * SLAB_MIN_OBJECTS)
+    slab_size <<= 1;
+  objects_per_slab = (slab_size - first_object) / stride;
+
+  slabs_partial = 0;
+  slabs_full = 0;
+  slabs_empty = 0;
+  empty_count = 0;
+
+  slab_count = 0;
+  active_objects = 0;
+  total_allocs = 0;
+  total_frees = 0;
+  failed_allocs = 0;
+
+  next_cache = 0;
+}
+
+// Unlinks 'slab' from the doubly linked 'list'
+void KmemCache::list_remove(Slab **list, Slab *slab) {
+  if (slab->prev != 0)
+    slab->prev->next = slab->next;
+  else
+    *list = slab->next;
+  if (slab->next != 0)
+    slab->next->prev = slab->prev;
+  slab->next = 0;
+  slab->prev = 0;
+}
+
+// Pushes 'slab' on the front of 'list'
+void KmemCache::list_push(Slab **list, Slab *slab) {
+  slab->prev = 0;
+  slab->next = *list;
+  if (*list != 0)
+    (*list)->prev = slab;
+  *list = slab;
+}
+
+/* Slab Creation
+ * Takes one slab from the heap and threads all of its objects onto the
+ * slab's free list.
+ * @return: New slab (already on the empty list) or 0 if the heap is full */
+Slab *KmemCache::grow() {
+  if (MemoryManager::active_memory_manager == 0)
+    return 0;
+
+  Slab *slab = (Slab *)MemoryManager::active_memory_manager->malloc_aligned(
+      slab_size, slab_size);
+  if (slab == 0)
+    return 0;
+
+  slab->cache = this;
+  slab->in_use = 0;
+  slab->free_list = 0;
+
+  // Thread objects in reverse so the lowest address is handed out first
+  for (int i = objects_per_slab - 1; i >= 0; i--) {
+    SlabObject *object =
+        (SlabObject *)((size_t)slab + first_object + i * stride);
+    object->next = slab->free_list;
+    slab->free_list = object;
+  }
+
+  list_push(&slabs_empty, slab);
+  empty_count++;
+  slab_count++;
+  return slab;
+}
+
+/* Slab Release
+ * @param slab: Empty slab (already unlinked) to give back to the heap */
+void KmemCache::release_slab(Slab *slab) {
+  slab_count--;
+  if (MemoryManager::active_memory_manager != 0)
+    MemoryManager::active_memory_manager->free(slab);
+}
+
+/* Object Allocation
+ * @return: Cache-line aligned object or 0 if out of memory */
+void *KmemCache::alloc() {
+  Slab *slab = slabs_partial;
+
+  // No partially used slab: take an empty one, growing the cache if needed
+  if (slab == 0) {
+    slab = slabs_empty;
+    if (slab == 0)
+      slab = grow();
+    if (slab == 0) {
+      failed_allocs++;
+      return 0;
+    }
+    list_remove(&slabs_empty, slab);
+    empty_count--;
+    list_push(&slabs_partial, slab);
+  }
+
+  SlabObject *object = slab->free_list;
+  slab->free_list = object->next;
+  slab->in_use++;
+
+  // Slab just became full
+  if (slab->free_list == 0) {
+    list_remove(&slabs_partial, slab);
+    list_push(&slabs_full, slab);
+  }
+
+  active_objects++;
+  total_allocs++;
+  return (void *)object;
+}
+
+/* Object Free
+ * @param ptr: Object previously returned by alloc() */
+void KmemCache::free(void *ptr) {
+  if (ptr == 0)
+    return;
+
+  Slab *slab = (Slab *)((size_t)ptr & ~(slab_size - 1));
+  if (slab->cache != this) {
+    libc::printf("kmem_cache_free: object does not belong to cache ");
+    libc::printf(name);
+    libc::printf("\n");
+    return;
+  }
+
+  bool was_full = (slab->free_list == 0);
+
+  SlabObject *object = (SlabObject *)ptr;
+  object->next = slab->free_list;
+  slab->free_list = object;
+  slab->in_use--;
+
+  active_objects--;
+  total_frees++;
+
+  if (was_full) {
+    list_remove(&slabs_full, slab);
+    list_push(&slabs_partial, slab);
+  }
+
+  // Slab just became empty: keep a few around, release the rest
+  if (slab->in_use == 0) {
+    list_remove(&slabs_partial, slab);
+    if (empty_count < SLAB_MAX_EMPTY_SLABS) {
+      list_push(&slabs_empty, slab);
+      empty_count++;
+    } else {
+      release_slab(slab);
+    }
+  }
+}
+
+/* Cache Shrink
+ * Releases every empty slab back to the heap */
+void KmemCache::shrink() {
+  while (slabs_empty != 0) {
+    Slab *slab = slabs_empty;
+    list_remove(&slabs_empty, slab);
+    empty_count--;
+    release_slab(slab);
+  }
+}
+
+size_t KmemCache::size() { return object_size; }
+
+/* Statistics Output
+ * Prints: name, object size, objects per slab, slabs, active objects,
+ * allocations, frees and failed allocations */
+void KmemCache::print_statistics() {
+  libc::printf(name);
+  libc::printf(": size ");
+  libc::print_int(object_size);
+  libc::printf(" per-slab ");
+  libc::print_int(objects_per_slab);
+  libc::printf(" slabs ");
+  libc::print_int(slab_count);
+  libc::printf(" active ");
+  libc::print_int(active_objects);
+  libc::printf(" allocs ");
+  libc::print_int(total_allocs);
+  libc::printf(" frees ");
+  libc::print_int(total_frees);
+  libc::printf(" failed ");
+  libc::print_int(failed_allocs);
+  libc::printf("\n");
+}
+
+KmemCache *kmem_cache_create(const char *name, size_t size, size_t align) {
+  if (size == 0 || (align & (align - 1)) != 0)
+    return 0;
+
+  // Plain 'new' is assumed never to return 0, so the null check would be
+  // dropped; allocate explicitly and construct in place
+  MemoryManager *heap = MemoryManager::active_memory_manager;
+  void *memory = heap != 0 ? heap->malloc(sizeof(KmemCache)) : 0;
+  if (memory == 0)
+    return 0;
+  KmemCache *cache = new (memory) KmemCache(name, size, align);
+
+  // Register the cache for statistics
+  cache->next_cache = cache_list;
+  cache_list = cache;
+  return cache;
+}
+
+void *kmem_cache_alloc(KmemCache *cache) {
+  if (cache == 0)
+    return 0;
+  return cache->alloc();
+}
+
+void kmem_cache_free(KmemCache *cache, void *ptr) {
+  if (cache != 0)
+    cache->free(ptr);
+}
+
+void kmem_cache_destroy(KmemCache *cache) {
+  if (cache == 0)
+    return;
+
+  if (cache->active_objects != 0) {
+    libc::printf("kmem_cache_destroy: objects still in use in ");
+    libc::printf(cache->name);
+    libc::printf("\n");
+  }
+
+  // Release every slab regardless of its state
+  Slab **lists[3] = {&cache->slabs_partial, &cache->slabs_full,
+                     &cache->slabs_empty};
+  for (int i = 0; i < 3; i++) {
+    while (*lists[i] != 0) {
+      Slab *slab = *lists[i];
+      KmemCache::list_remove(lists[i], slab);
+      cache->release_slab(slab);
+    }
+  }
+
+  // Unregister the cache
+  KmemCache **link = &cache_list;
+  while (*link != 0 && *link != cache)
+    link = &(*link)->next_cache;
+  if (*link == cache)
+    *link = cache->next_cache;
+
+  MemoryManager::active_memory_manager->free(cache);
+}
+
+void kmem_cache_print_statistics() {
+  if (cache_list == 0) {
+    libc::printf("No slab caches\n");
+    return;
+  }
+  for (KmemCache *cache = cache_list; cache != 0; cache = cache->next_cache)
+    cache->print_statistics();
+}
+
+} // namespace memorymanagement
+} // namespace uqaabOS
@@ -2,14 +2,101 @@
 // #include "../include/gdt.h"
 
 #include "../include/gdt.h"
+#include "../include/interrupts.h"
+#include "../include/memorymanagement/paging.h"
+#include "../include/memorymanagement/slab.h"
+#include "../include/libc/stdio.h"
 
 namespace uqaabOS {
 namespace multitasking {
+/*
+ * Scheduling Approach:
+ * - Every priority level has a FIFO run queue of READY tasks, and bit p of
+ *   ready_bitmap is set while queue p is non-empty. The next task is the
+ *   head of queue ctz(ready_bitmap), so picking costs the same no matter
+ *   how many tasks exist.
+ * - Blocked and sleeping tasks are on no run queue, so they cost nothing
+ *   per tick or per switch.
+ * - Within one priority, tasks take turns: a preempted task goes to the
+ *   tail of its queue. A task is also preempted early when a task of a
+ *   higher priority becomes ready.
+ * - When nothing is ready, the boot context that called kernel_main is
+ *   resumed and acts as the idle loop.
+ * - Task lifecycle: spawn() takes the Task from a slab cache and its stack
+ *   from the frame allocator (one-page stacks) or the heap. Returning from
+ *   the entry point lands in task_exit_trampoline, which calls exit().
+ *   An exited task cannot free the stack it is still running on, so it is
+ *   parked on the zombie list and its stack is released by the next reap()
+ *   (run from spawn, join and the idle loop).
+ * - Waiting: sleep_on() parks the running task on a WaitQueue as BLOCKED,
+ *   sleep_ticks() on the tick-ordered sleep list as SLEEPING; neither is on
+ *   a run queue. wake_up() and tick() make them ready again, and when the
+ *   woken task outranks the running one the switch happens on the way out
+ *   of the interrupt (needs_reschedule) instead of at the next quantum.
+ */
+
+// Low 32 bits of the time stamp counter; enough to time a single switch.
+static inline uint32_t read_cycle_counter() {
+  uint32_t low, high;
+  asm volatile("rdtsc" : "=a"(low), "=d"(high));
+  return low;
+}
+
+TaskManager *TaskManager::active_task_manager = 0;
+
+// Task objects created by spawn(); made on first use since the heap does
+// not exist yet when the TaskManager is constructed.
+static memorymanagement::KmemCache *task_cache = 0;
+
+// Return address of every task's entry point
+static void task_exit_trampoline() {
+  TaskManager::active_task_manager->exit(0);
+}
+
+Task::Task(uqaabOS::include::GDT *gdt, void (*entry_point)(),
+           memorymanagement::PageDirectory *page_directory,
+           uint32_t stack_size, void *argument) {
+  this->page_directory = page_directory;
+  owns_page_directory = false; // The caller keeps it unless spawn() takes it
+  quantum = TASK_DEFAULT_QUANTUM;
+  ticks_left = quantum;
+  state = TASK_BLOCKED; // Not runnable until added to a TaskManager
+  priority = TASK_DEFAULT_PRIORITY;
+  next = 0;
+  prev = 0;
+  exit_code = 0;
+  detached = false;
+  from_task_cache = false;
+  joiner = 0;
+  wait_next = 0;
+  waiting_on = 0;
+  sleep_next = 0;
+  wake_tick = 0;
+  wait_timed_out = false;
+  cpu_state = 0;
+
+  if (stack_size < TASK_MIN_STACK_SIZE)
+    stack_size = TASK_MIN_STACK_SIZE;
+  stack_size = (stack_size + 15) & ~15u;
+  this->stack_size = stack_size;
+
+  // One-page stacks come straight from the frame allocator
+  stack = 0;
+  stack_from_frames = false;
+  if (stack_size == PAGE_SIZE &&
+      memorymanagement::PageFrameAllocator::active_page_frame_allocator != 0) {
+    stack = (uint8_t *)memorymanagement::PageFrameAllocator::
+                active_page_frame_allocator->allocate_frame();
+    stack_from_frames = stack != 0;
+  }
+  if (stack == 0 && memorymanagement::MemoryManager::active_memory_manager != 0)
+    stack = (uint8_t *)memorymanagement::MemoryManager::active_memory_manager
+                ->malloc_aligned(stack_size, 16);
+  if (stack == 0)
+    return;
 
-Task::Task(uqaabOS::include::GDT *gdt, void (*entry_point)()) {
   // Place CPUState at the top of the stack (highest address)
-  cpu_state = (CPUState *)(stack + 4096 - sizeof(CPUState));
-  // static_assert(sizeof(CPUState) <= 4096, "CPUState too large for stack");
+  cpu_state = (CPUState *)(stack + stack_size - sizeof(CPUState));
 
   // Initialize registers
   cpu_state->eax = 0;
@@ -19,53 +106,530 @@ Task::Task(uqaabOS::include::GDT *gdt, void (*entry_point)()) {
   cpu_state->esi = 0;
   cpu_state->edi = 0;
   cpu_state->ebp = 0;
+  cpu_state->error = 0;
 
-  // Set esp to the TOP of the stack (stack + 4096)
-  cpu_state->esp = (uint32_t)(stack + 4096);
+  // An iret to the same privilege level pops only eip, cs and eflags, so
+  // the task starts with esp pointing at cpu_state->esp. That slot becomes
+  // the entry point's return address and the ss slot its first argument.
+  cpu_state->esp = (uint32_t)task_exit_trampoline;
+  cpu_state->ss = (uint32_t)argument;
 
   // Set execution context
   cpu_state->eip = (uint32_t)entry_point;
-  cpu_state->ss = gdt->data_segment_selector();
   cpu_state->cs = gdt->code_segment_selector();
   cpu_state->eflags = 0x202; // Enable interrupts
 }
 
-Task::~Task() {}
+Task::~Task() {
+  release_stack();
+  release_page_directory();
+}
+
+void Task::release_stack() {
+  if (stack == 0)
+    return;
+  if (stack_from_frames)
+    memorymanagement::PageFrameAllocator::active_page_frame_allocator
+        ->free_frame(stack);
+  else
+    memorymanagement::MemoryManager::active_memory_manager->free(stack);
+  stack = 0;
+}
+
+// Destroys the task's address space if spawn() handed it over.
+void Task::release_page_directory() {
+  if (!owns_page_directory)
+    return;
+  if (memorymanagement::PagingManager::active_paging_manager != 0)
+    memorymanagement::PagingManager::active_paging_manager
+        ->destroy_address_space(page_directory);
+  page_directory = 0;
+  owns_page_directory = false;
+}
+
+bool Task::is_valid() { return stack != 0; }
+
+void Task::set_quantum(uint32_t ticks) { quantum = ticks ? ticks : 1; }
+
+TaskState Task::get_state() { return state; }
+
+uint8_t Task::get_priority() { return priority; }
 
-TaskManager::TaskManager() {
+TaskManager::TaskManager(include::GDT *gdt) {
+  this->gdt = gdt;
+  zombies = 0;
+  sleepers = 0;
+  ticks = 0;
+  tick_frequency = 0;
+  reschedule_pending = false;
+  for (int i = 0; i < TASK_PRIORITY_LEVELS; i++) {
+    run_queue_head[i] = 0;
+    run_queue_tail[i] = 0;
+  }
+  ready_bitmap = 0;
   num_tasks = 0;
-  current_task = -1;
+  current_task = 0;
+  idle_cpu_state = 0;
+  switch_count = 0;
+  last_switch_cycles = 0;
+  average_switch_cycles = 0;
+  max_switch_cycles = 0;
+  active_task_manager = this;
 }
 
-TaskManager::~TaskManager() {}
+TaskManager::~TaskManager() {
+  if (active_task_manager == this)
+    active_task_manager = 0;
+}
 
-bool TaskManager::add_task(Task *task) {
+void TaskManager::enqueue(Task *task) {
+  task->state = TASK_READY;
+  task->next = 0;
+  task->prev = run_queue_tail[task->priority];
+  if (task->prev != 0)
+    task->prev->next = task;
+  else
+    run_queue_head[task->priority] = task;
+  run_queue_tail[task->priority] = task;
+  ready_bitmap |= 1u << task->priority;
+}
 
-  if (num_tasks >= 256)
+void TaskManager::dequeue(Task *task) {
+  if (task->prev != 0)
+    task->prev->next = task->next;
+  else
+    run_queue_head[task->priority] = task->next;
+  if (task->next != 0)
+    task->next->prev = task->prev;
+  else
+    run_queue_tail[task->priority] = task->prev;
+  task->next = 0;
+  task->prev = 0;
+  if (run_queue_head[task->priority] == 0)
+    ready_bitmap &= ~(1u << task->priority);
+}
+
+bool TaskManager::add_task(Task *task) {
+  if (task == 0 || !task->is_valid())
     return false;
 
-  tasks[num_tasks++] = task;
+  num_tasks++;
+  enqueue(task);
 
   return true;
 }
 
-CPUState *TaskManager::schedule(CPUState *cpu_state) {
-  if (num_tasks <= 0) {
-    return cpu_state;
+Task *TaskManager::get_current_task() { return current_task; }
+
+/* Task Creation
+ * @param entry_point: Function run by the task, called with 'argument'
+ * @param stack_size: Stack size in bytes (PAGE_SIZE uses a single frame)
+ * @param priority: Run queue priority, 0 is the highest
+ * @param detached: Reap on exit instead of waiting for join()
+ * @param page_directory: Address space to run in, 0 for the kernel's; on
+ *                        success the task owns it and reaping destroys it
+ * @return: The new task, already ready to run, or 0 on failure */
+Task *TaskManager::spawn(void (*entry_point)(void *), void *argument,
+                         uint32_t stack_size, uint8_t priority, bool detached,
+                         memorymanagement::PageDirectory *page_directory) {
+  if (gdt == 0)
+    return 0;
+
+  uint32_t flags = disable_interrupts();
+  reap();
+
+  if (task_cache == 0)
+    task_cache = memorymanagement::kmem_cache_create("task", sizeof(Task), 0);
+  void *memory = memorymanagement::kmem_cache_alloc(task_cache);
+  if (memory == 0) {
+    restore_interrupts(flags);
+    return 0;
+  }
+
+  Task *task = new (memory) Task(gdt, (void (*)())entry_point, page_directory,
+                                 stack_size, argument);
+  if (!task->is_valid()) {
+    task->~Task();
+    memorymanagement::kmem_cache_free(task_cache, task);
+    restore_interrupts(flags);
+    return 0;
+  }
+
+  task->from_task_cache = true;
+  task->owns_page_directory = page_directory != 0;
+  task->detached = detached;
+  task->priority = priority > TASK_LOWEST_PRIORITY ? TASK_LOWEST_PRIORITY
+                                                    : priority;
+  add_task(task);
+
+  restore_interrupts(flags);
+  return task;
+}
+
+/* Task Exit
+ * Parks the running task on the zombie list, wakes a joiner and switches
+ * away for good.
+ * @param exit_code: Value returned by join() */
+void TaskManager::exit(int exit_code) {
+  uint32_t flags = disable_interrupts();
+  Task *task = current_task;
+  if (task == 0) {
+    libc::printf("exit: not called from a task\n");
+    restore_interrupts(flags);
+    return;
+  }
+
+  task->exit_code = exit_code;
+  task->state = TASK_EXITED;
+  task->next = zombies;
+  zombies = task;
+  if (task->joiner != 0)
+    make_ready(task->joiner);
+
+  yield();
+  while (1)
+    asm volatile("hlt");
+}
+
+/* Task Join
+ * @param task: Task returned by spawn() with detached == false
+ * @return: The task's exit code, -1 if it cannot be joined */
+int TaskManager::join(Task *task) {
+  if (task == 0 || task->detached || !task->from_task_cache)
+    return -1;
+
+  uint32_t flags = disable_interrupts();
+  while (task->state != TASK_EXITED) {
+    if (current_task != 0 && task->joiner == 0) {
+      // Sleep until exit() makes us ready again
+      task->joiner = current_task;
+      block(current_task, TASK_BLOCKED);
+      yield();
+      task->joiner = 0;
+    } else {
+      // Idle context (or a second joiner): wait for the next interrupt
+      asm volatile("sti; hlt; cli" : : : "memory");
+    }
+  }
+
+  reap();
+  int exit_code = task->exit_code;
+  task->~Task();
+  memorymanagement::kmem_cache_free(task_cache, task);
+
+  restore_interrupts(flags);
+  return exit_code;
+}
+
+void TaskManager::yield() {
+  asm volatile("int %0" : : "i"(TASK_YIELD_INTERRUPT) : "memory");
+}
+
+/* Zombie Reaping
+ * Releases the stack and any owned address space of every exited task
+ * other than the running one; detached tasks are freed entirely, others
+ * wait for join(). */
+void TaskManager::reap() {
+  uint32_t flags = disable_interrupts();
+
+  Task **link = &zombies;
+  while (*link != 0) {
+    Task *task = *link;
+    if (task == current_task) {
+      link = &task->next;
+      continue;
+    }
+    *link = task->next;
+    task->next = 0;
+    task->release_stack();
+    task->release_page_directory();
+    num_tasks--;
+
+    if (task->detached && task->from_task_cache) {
+      task->~Task();
+      memorymanagement::kmem_cache_free(task_cache, task);
+    }
   }
 
-  // Save current task's state
-  if (current_task >= 0) {
-    tasks[current_task]->cpu_state = cpu_state;
+  restore_interrupts(flags);
+}
+
+void TaskManager::make_ready(Task *task) {
+  if (task->state != TASK_BLOCKED && task->state != TASK_SLEEPING)
+    return;
+  enqueue(task);
+  if (current_task == 0 || task->priority < current_task->priority)
+    reschedule_pending = true;
+}
+
+void TaskManager::sleep_on(WaitQueue *queue) {
+  uint32_t flags = disable_interrupts();
+
+  if (interrupts::InterruptManager::in_interrupt()) {
+    // Cannot block here; the caller polls
+  } else if (current_task == 0) {
+    // Idle context: sti takes effect after hlt starts, so no wakeup is lost
+    asm volatile("sti; hlt; cli" : : : "memory");
+  } else {
+    Task *task = current_task;
+    task->waiting_on = queue;
+    task->wait_next = 0;
+    if (queue->tail != 0)
+      queue->tail->wait_next = task;
+    else
+      queue->head = task;
+    queue->tail = task;
+    block(task, TASK_BLOCKED);
+    yield();
   }
 
-  // Select next task
-  if (++current_task >= num_tasks) {
-    current_task = 0;
+  restore_interrupts(flags);
+}
+
+/* Bounded Wait
+ * The task sits on 'queue' and on the sleep list at the same time; whichever
+ * fires first takes it off the other one.
+ * @param queue: Queue to wait on
+ * @param count: Timeout in timer ticks
+ * @return: false if the timeout expired first */
+bool TaskManager::sleep_on_timeout(WaitQueue *queue, uint32_t count) {
+  if (tick_frequency == 0 || count == 0 || current_task == 0 ||
+      interrupts::InterruptManager::in_interrupt()) {
+    sleep_on(queue);
+    return true;
   }
 
-  // Return next task's state
-  return tasks[current_task]->cpu_state;
+  uint32_t flags = disable_interrupts();
+  Task *task = current_task;
+  task->wait_timed_out = false;
+  add_sleeper(task, ticks + count);
+  sleep_on(queue);
+  bool woken = !task->wait_timed_out;
+  restore_interrupts(flags);
+  return woken;
+}
+
+void TaskManager::add_sleeper(Task *task, uint64_t wake_tick) {
+  // Keep the list ordered by wake-up tick
+  task->wake_tick = wake_tick;
+  Task **link = &sleepers;
+  while (*link != 0 && (*link)->wake_tick <= wake_tick)
+    link = &(*link)->sleep_next;
+  task->sleep_next = *link;
+  *link = task;
+}
+
+void TaskManager::remove_sleeper(Task *task) {
+  for (Task **link = &sleepers; *link != 0; link = &(*link)->sleep_next) {
+    if (*link == task) {
+      *link = task->sleep_next;
+      break;
+    }
+  }
+  task->sleep_next = 0;
+  task->wake_tick = 0;
+}
+
+void TaskManager::remove_waiter(WaitQueue *queue, Task *task) {
+  Task *previous = 0;
+  for (Task *waiter = queue->head; waiter != 0; waiter = waiter->wait_next) {
+    if (waiter == task) {
+      if (previous != 0)
+        previous->wait_next = task->wait_next;
+      else
+        queue->head = task->wait_next;
+      if (queue->tail == task)
+        queue->tail = previous;
+      break;
+    }
+    previous = waiter;
+  }
+  task->wait_next = 0;
+  task->waiting_on = 0;
+}
+
+void TaskManager::wake_up(WaitQueue *queue) {
+  uint32_t flags = disable_interrupts();
+
+  Task *task = queue->head;
+  queue->head = 0;
+  queue->tail = 0;
+  while (task != 0) {
+    Task *next = task->wait_next;
+    task->wait_next = 0;
+    task->waiting_on = 0;
+    if (task->wake_tick != 0) // Bounded wait: cancel the timeout
+      remove_sleeper(task);
+    make_ready(task);
+    task = next;
+  }
+
+  // From task context, let a more important task run right away
+  if (reschedule_pending && current_task != 0 &&
+      !interrupts::InterruptManager::in_interrupt())
+    yield();
+
+  restore_interrupts(flags);
+}
+
+/* Timed Sleep
+ * @param count: Timer ticks to sleep; 0 just yields */
+void TaskManager::sleep_ticks(uint32_t count) {
+  uint32_t flags = disable_interrupts();
+  uint64_t target = ticks + count;
+
+  if (interrupts::InterruptManager::in_interrupt() || tick_frequency == 0) {
+    // No timer, or cannot block: nothing sensible to wait on
+  } else if (current_task == 0) {
+    while (ticks < target)
+      asm volatile("sti; hlt; cli" : : : "memory");
+  } else if (count == 0) {
+    yield();
+  } else {
+    add_sleeper(current_task, target);
+    block(current_task, TASK_SLEEPING);
+    yield();
+  }
+
+  restore_interrupts(flags);
+}
+
+void TaskManager::sleep(uint32_t milliseconds) {
+  if (tick_frequency == 0)
+    return;
+  // Rounded up so the sleep is never shorter than requested
+  sleep_ticks(milliseconds_to_ticks(milliseconds));
+}
+
+void TaskManager::set_tick_frequency(uint32_t frequency) {
+  tick_frequency = frequency;
+}
+
+uint32_t TaskManager::milliseconds_to_ticks(uint32_t milliseconds) {
+  if (tick_frequency == 0)
+    return 0;
+  return (milliseconds * tick_frequency + 999) / 1000;
+}
+
+uint64_t TaskManager::get_ticks() {
+  uint32_t flags = disable_interrupts();
+  uint64_t value = ticks;
+  restore_interrupts(flags);
+  return value;
+}
+
+bool TaskManager::needs_reschedule() { return reschedule_pending; }
+
+void TaskManager::block(Task *task, TaskState state) {
+  if (task->state == TASK_READY)
+    dequeue(task);
+  task->state = state;
+}
+
+void TaskManager::set_priority(Task *task, uint8_t priority) {
+  if (priority > TASK_LOWEST_PRIORITY)
+    priority = TASK_LOWEST_PRIORITY;
+  if (task->state == TASK_READY) {
+    dequeue(task);
+    task->priority = priority;
+    enqueue(task);
+  } else {
+    task->priority = priority;
+  }
+}
+
+bool TaskManager::tick() {
+  ticks++;
+
+  // Wake every sleeper whose time has come (the list is sorted)
+  while (sleepers != 0 && sleepers->wake_tick <= ticks) {
+    Task *task = sleepers;
+    sleepers = task->sleep_next;
+    task->sleep_next = 0;
+    task->wake_tick = 0;
+    if (task->waiting_on != 0) { // Bounded wait timed out
+      remove_waiter(task->waiting_on, task);
+      task->wait_timed_out = true;
+    }
+    make_ready(task);
+  }
+
+  if (reschedule_pending)
+    return true;
+
+  // Idle: switch as soon as anything is ready
+  if (current_task == 0)
+    return ready_bitmap != 0;
+
+  // A higher priority task became ready
+  if (ready_bitmap & ((1u << current_task->priority) - 1))
+    return true;
+
+  if (current_task->ticks_left > 1) {
+    current_task->ticks_left--;
+    return false;
+  }
+  return true;
+}
+
+CPUState *TaskManager::schedule(CPUState *cpu_state) {
+  uint32_t start = read_cycle_counter();
+  Task *previous = current_task;
+  reschedule_pending = false;
+
+  // Save the outgoing context; a task that is still runnable goes to the
+  // tail of its queue, a blocked or sleeping one stays off the queues
+  if (previous != 0) {
+    previous->cpu_state = cpu_state;
+    if (previous->state == TASK_RUNNING)
+      enqueue(previous);
+  } else {
+    idle_cpu_state = cpu_state;
+  }
+
+  // Pick the head of the highest non-empty priority queue
+  Task *next = 0;
+  if (ready_bitmap != 0) {
+    next = run_queue_head[__builtin_ctz(ready_bitmap)];
+    dequeue(next);
+    next->state = TASK_RUNNING;
+    next->ticks_left = next->quantum;
+  }
+  current_task = next;
+
+  if (next == previous)
+    return cpu_state;
+
+  // Load the next task's address space (no-op while paging is off)
+  if (memorymanagement::PagingManager::active_paging_manager != 0)
+    memorymanagement::PagingManager::active_paging_manager->switch_directory(
+        next != 0 ? next->page_directory : 0);
+
+  uint32_t cycles = read_cycle_counter() - start;
+  switch_count++;
+  last_switch_cycles = cycles;
+  if (cycles > max_switch_cycles)
+    max_switch_cycles = cycles;
+  if (switch_count == 1)
+    average_switch_cycles = cycles;
+  else
+    average_switch_cycles =
+        average_switch_cycles - average_switch_cycles / 8 + cycles / 8;
+
+  return next != 0 ? next->cpu_state : idle_cpu_state;
+}
+
+void TaskManager::print_statistics() {
+  int ready = 0;
+  for (int i = 0; i < TASK_PRIORITY_LEVELS; i++)
+    for (Task *task = run_queue_head[i]; task != 0; task = task->next)
+      ready++;
+
+  libc::printf("Tasks:           %d (%d ready)\n", num_tasks, ready);
+  libc::printf("Switches:        %d\n", (int)switch_count);
+  libc::printf("Switch latency:  %d cycles last, %d avg, %d max\n",
+               (int)last_switch_cycles, (int)average_switch_cycles,
+               (int)max_switch_cycles);
 }
 } // namespace multitasking
 
@@ -9,6 +9,8 @@ Terminal::Terminal(filesystem::FAT32* fat32_instance) {
     for (int i = 0; i < TERMINAL_BUFFER_SIZE; i++) {
         this->input_buffer[i] = '\0';
     }
+    this->key_head = 0;
+    this->key_count = 0;
 }
 
 void Terminal::initialize() {
@@ -106,6 +108,20 @@ void Terminal::execute_command(char* command) {
         handle_write(argc, argv);
     } else if (libc::strcmp(argv[0], "echo") == 0) {
         handle_echo(argc, argv);
+    } else if (libc::strcmp(argv[0], "slabinfo") == 0) {
+        handle_slabinfo();
+    } else if (libc::strcmp(argv[0], "sched") == 0) {
+        handle_sched();
+    } else if (libc::strcmp(argv[0], "meminfo") == 0) {
+        handle_meminfo();
+    } else if (libc::strcmp(argv[0], "buddyinfo") == 0) {
+        handle_buddyinfo();
+    } else if (libc::strcmp(argv[0], "df") == 0) {
+        handle_df();
+    } else if (libc::strcmp(argv[0], "sync") == 0) {
+        handle_sync();
+    } else if (libc::strcmp(argv[0], "cacheinfo") == 0) {
+        handle_cacheinfo();
     } else if (libc::strcmp(argv[0], "help") == 0) {
         handle_help();
     } else if (libc::strcmp(argv[0], "clear") == 0) {
@@ -218,6 +234,56 @@ void Terminal::handle_echo(int argc, char* argv[]) {
     libc::printf("\n");
 }
 
+void Terminal::handle_slabinfo() {
+    memorymanagement::kmem_cache_print_statistics();
+}
+
+void Terminal::handle_sched() {
+    driver::PITDriver* timer = driver::PITDriver::active_timer;
+    if (timer != 0) {
+        libc::printf("Timer frequency: %d Hz\n", (int)timer->get_frequency());
+        libc::printf("Ticks:           %d\n", (int)timer->get_ticks());
+        libc::printf("Uptime:          %d ms\n", (int)timer->uptime_ms());
+    } else {
+        libc::printf("No timer driver\n");
+    }
+    if (multitasking::TaskManager::active_task_manager != 0)
+        multitasking::TaskManager::active_task_manager->print_statistics();
+}
+
+void Terminal::handle_meminfo() {
+    if (memorymanagement::MemoryManager::active_memory_manager == 0) {
+        libc::printf("No active memory manager\n");
+        return;
+    }
+    memorymanagement::MemoryManager::active_memory_manager->print_statistics();
+}
+
+void Terminal::handle_buddyinfo() {
+    if (memorymanagement::MemoryManager::active_memory_manager == 0) {
+        libc::printf("No active memory manager\n");
+        return;
+    }
+    memorymanagement::MemoryManager::active_memory_manager->print_buddy_statistics();
+}
+
+void Terminal::handle_df() {
+    fat32->df();
+}
+
+void Terminal::handle_sync() {
+    if (fat32->sync())
+        libc::printf("Filesystem synced\n");
+}
+
+void Terminal::handle_cacheinfo() {
+    if (driver::BufferCache::active_cache == 0) {
+        libc::printf("No buffer cache\n");
+        return;
+    }
+    driver::BufferCache::active_cache->print_statistics();
+}
+
 void Terminal::handle_help() {
     libc::printf("Available commands:\n");
     libc::printf("  ls [path]          - List directory contents\n");
@@ -228,6 +294,13 @@ void Terminal::handle_help() {
     libc::printf("  cat <path>         - Display file contents\n");
     libc::printf("  write <file> <text> - Write text to file\n");
     libc::printf("  echo <text>        - Display text\n");
+    libc::printf("  df                 - Show filesystem size and free space\n");
+    libc::printf("  sync               - Write cached changes to disk\n");
+    libc::printf("  meminfo            - Show heap statistics\n");
+    libc::printf("  sched              - Show timer and scheduler statistics\n");
+    libc::printf("  slabinfo           - Show slab cache statistics\n");
+    libc::printf("  buddyinfo          - Show buddy allocator free blocks\n");
+    libc::printf("  cacheinfo          - Show disk buffer cache statistics\n");
     libc::printf("  clear              - Clear screen\n");
     libc::printf("  help               - Show this help\n");
 }
@@ -315,10 +388,30 @@ void Terminal::handle_write(int argc, char* argv[]) {
     libc::printf("'\n");
 }
 
+void Terminal::queue_key(char c) {
+    // Drop the key if the terminal task has fallen this far behind
+    if (key_count >= TERMINAL_KEY_BUFFER_SIZE)
+        return;
+    key_buffer[(key_head + key_count) % TERMINAL_KEY_BUFFER_SIZE] = c;
+    key_count++;
+    if (multitasking::TaskManager::active_task_manager != 0)
+        multitasking::TaskManager::active_task_manager->wake_up(&key_queue);
+}
+
+char Terminal::read_key() {
+    uint32_t flags = multitasking::disable_interrupts();
+    while (key_count == 0)
+        multitasking::TaskManager::active_task_manager->sleep_on(&key_queue);
+    char c = key_buffer[key_head];
+    key_head = (key_head + 1) % TERMINAL_KEY_BUFFER_SIZE;
+    key_count--;
+    multitasking::restore_interrupts(flags);
+    return c;
+}
+
 void Terminal::run() {
-    // Terminal main loop would go here if we had a proper input system
-    // For now, this is just a placeholder
-    initialize();
+    while (1)
+        handle_key_press(read_key());
 }
 
 } // namespace terminal
@@ -4,8 +4,9 @@ namespace uqaabOS {
 namespace terminal {
 
 void TerminalKeyboardEventHandler::on_key_down(char c) {
+  // Runs in IRQ1: only queue the key, the terminal task processes it
   if (terminal != nullptr) {
-    terminal->handle_key_press(c);
+    terminal->queue_key(c);
   }
 }
 